@@ -19,7 +19,6 @@
 #include "stdafx.h"
 
 #include "CListCtrl_SortItemsEx.h"
-#include "Calls.h"
 #include "mainDlg.h"
 
 BEGIN_MESSAGE_MAP(CListCtrl_SortItemsEx, CListCtrl)
@@ -44,29 +43,6 @@ namespace {
 	int CALLBACK SortFunc(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort)
 	{
 		PARAMSORT& ps = *(PARAMSORT*)lParamSort;
-		if (ps.m_ColumnIndex == 2 && mainDlg && mainDlg->pageCalls) {
-			CListCtrl *list = (CListCtrl*)mainDlg->pageCalls->GetDlgItem(IDC_CALLS);
-			if (list && ps.m_hWnd==list->m_hWnd) {
-				LVITEM item;
-				item.iItem = lParam1;
-				item.iSubItem = 0;
-				item.mask = LVIF_PARAM;
-				ListView_GetItem(ps.m_hWnd,&item);
-				Call *pCall1 = (Call *)item.lParam;
-				item.iItem = lParam2;
-				ListView_GetItem(ps.m_hWnd,&item);
-				Call *pCall2 = (Call *)item.lParam;
-				if (ps.m_Ascending) {
-					if (pCall1->time > pCall2->time) return 1;
-					else if (pCall1->time < pCall2->time) return -1;
-					else return 0;
-				} else {
-					if (pCall1->time > pCall2->time) return -1;
-					else if (pCall1->time < pCall2->time) return 1;
-					else return 0;
-				}
-			}
-		}
 		if (mainDlg && mainDlg->pageContacts) {
 			CListCtrl *list = (CListCtrl*)mainDlg->pageContacts->GetDlgItem(IDC_CONTACTS);
 			if (list && ps.m_hWnd==list->m_hWnd) {
@@ -100,9 +76,29 @@ namespace {
 	}
 }
 
+CListCtrl_SortItemsEx::CListCtrl_SortItemsEx()
+{
+	sortRowsProc = NULL;
+	sortRowsParam = NULL;
+}
+
+void CListCtrl_SortItemsEx::SetSortRowsProc(SortRowsProc proc, void* param)
+{
+	sortRowsProc = proc;
+	sortRowsParam = param;
+}
+
 bool CListCtrl_SortItemsEx::SortColumn(int columnIndex, bool ascending)
 {
 	HWND h = GetSafeHwnd();
+	if (GetStyle() & LVS_OWNERDATA) {
+		// virtual lists are sorted in their model
+		if (sortRowsProc) {
+			sortRowsProc(columnIndex, ascending, sortRowsParam);
+			return true;
+		}
+		return false;
+	}
 	PARAMSORT paramsort(h, columnIndex, ascending);
 	ListView_SortItemsEx(h, SortFunc, &paramsort);
 	return true;
@@ -2,10 +2,19 @@
 
 #include "CListCtrl_Sortable.h"
 
+// sorts the model of a virtual (LVS_OWNERDATA) list, which has no items to sort
+typedef void (*SortRowsProc)(int columnIndex, bool ascending, void* param);
+
 class CListCtrl_SortItemsEx : public CListCtrl_Sortable
 {
 	DECLARE_MESSAGE_MAP();
 
 public:
+	CListCtrl_SortItemsEx();
+	void SetSortRowsProc(SortRowsProc proc, void* param);
 	virtual bool SortColumn(int columnIndex, bool ascending);
+
+private:
+	SortRowsProc sortRowsProc;
+	void* sortRowsParam;
 };
\ No newline at end of file
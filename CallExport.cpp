@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "CallExport.h"
+#include "CallHistory.h"
+
+#define CALL_EXPORT_BUFFER 65536
+
+typedef void (*CallExportLineProc)(const char* line, int len, ULONGLONG offset, void* param);
+
+struct CallExportSegment {
+	CallExport* data;
+	CFile* output;
+	CStringA* buffer;
+	// offset of the last line of every record still present
+	CMap<int, int, ULONGLONG, ULONGLONG> last;
+};
+
+static bool CallExportOpen(CString filename, CFile* file)
+{
+	// shared for delete too, so a compaction replacing the journal meanwhile goes
+	// ahead and this handle keeps reading the old file
+	HANDLE handle = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	file->m_hFile = handle;
+	file->m_bCloseOnDelete = TRUE;
+	return true;
+}
+
+// lines of the file up to end, with the offset each starts at
+static void CallExportLines(CFile* file, ULONGLONG end, CallExportLineProc proc, void* param)
+{
+	file->SeekToBegin();
+	ULONGLONG offset = 0;
+	CStringA chunk;
+	int carry = 0;
+	while (offset + carry < end) {
+		char* p = chunk.GetBuffer(carry + CALL_EXPORT_BUFFER);
+		UINT len = file->Read(p + carry, (UINT)min((ULONGLONG)CALL_EXPORT_BUFFER, end - offset - carry));
+		if (!len) {
+			chunk.ReleaseBuffer(0);
+			break;
+		}
+		len += carry;
+		UINT start = 0;
+		for (UINT i = 0; i < len; i++) {
+			if (p[i] == '\n') {
+				int lineLen = i - start;
+				if (lineLen && p[i - 1] == '\r') {
+					lineLen--;
+				}
+				proc(p + start, lineLen, offset + start, param);
+				start = i + 1;
+			}
+		}
+		offset += start;
+		carry = len - start;
+		if (carry) {
+			memmove(p, p + start, carry);
+		}
+		chunk.ReleaseBuffer(carry);
+	}
+}
+
+static int CallExportKey(const char* line, int len, const char** value)
+{
+	const char* sep = (const char*)memchr(line, '=', len);
+	if (!sep || sep == line) {
+		return -1;
+	}
+	*value = sep + 1;
+	return atoi(CStringA(line, (int)(sep - line)));
+}
+
+static void CallExportCollect(const char* line, int len, ULONGLONG offset, void* param)
+{
+	CallExportSegment* segment = (CallExportSegment*)param;
+	const char* value;
+	int key = CallExportKey(line, len, &value);
+	if (key < 0) {
+		return;
+	}
+	if (line + len - value == 4 && !memcmp(value, "null", 4)) {
+		segment->last.RemoveKey(key);
+	}
+	else {
+		segment->last.SetAt(key, offset);
+	}
+}
+
+static CString CallExportType(int type)
+{
+	return type == MSIP_CALL_OUT ? _T("out") : (type == MSIP_CALL_IN ? _T("in") :
+		(type == MSIP_CALL_MISS ? _T("miss") : _T("else")));
+}
+
+static CString CallExportCSV(CString str)
+{
+	if (str.FindOneOf(_T(",\"")) == -1) {
+		return str;
+	}
+	str.Replace(_T("\""), _T("\"\""));
+	return _T("\"") + str + _T("\"");
+}
+
+static CString CallExportXML(CString str)
+{
+	str.Replace(_T("&"), _T("&amp;"));
+	str.Replace(_T("<"), _T("&lt;"));
+	str.Replace(_T(">"), _T("&gt;"));
+	str.Replace(_T("\""), _T("&quot;"));
+	return str;
+}
+
+static CString CallExportJSON(CString str)
+{
+	CString res;
+	for (int i = 0; i < str.GetLength(); i++) {
+		TCHAR c = str.GetAt(i);
+		if (c == '"' || c == '\\') {
+			res.AppendChar('\\');
+			res.AppendChar(c);
+		}
+		else if (c < 0x20) {
+			res.AppendFormat(_T("\\u%04x"), c);
+		}
+		else {
+			res.AppendChar(c);
+		}
+	}
+	return res;
+}
+
+static void CallExportRecord(const char* line, int len, ULONGLONG offset, void* param)
+{
+	CallExportSegment* segment = (CallExportSegment*)param;
+	const char* value;
+	int key = CallExportKey(line, len, &value);
+	ULONGLONG last;
+	if (key < 0 || !segment->last.Lookup(key, last) || last != offset) {
+		// superseded or deleted later in the journal
+		return;
+	}
+	Call call;
+	CallHistory::CallDecode(MSIP::Utf8DecodeUni(value, (int)(line + len - value)), &call);
+	CallExport* data = segment->data;
+	if ((data->timeFrom && call.time < data->timeFrom) || (data->timeTo && call.time >= data->timeTo)) {
+		return;
+	}
+	CString str;
+	switch (data->format) {
+	case MSIP_CALL_EXPORT_XML:
+		str.Format(_T("<call type=\"%s\" name=\"%s\" number=\"%s\" time=\"%d\" duration=\"%d\" info=\"%s\"/>\r\n"),
+			CallExportType(call.type), CallExportXML(call.name), CallExportXML(call.number), call.time, call.duration, CallExportXML(call.info));
+		break;
+	case MSIP_CALL_EXPORT_NDJSON:
+		str.Format(_T("{\"type\":\"%s\",\"name\":\"%s\",\"number\":\"%s\",\"time\":%d,\"duration\":%d,\"info\":\"%s\"}\n"),
+			CallExportType(call.type), CallExportJSON(call.name), CallExportJSON(call.number), call.time, call.duration, CallExportJSON(call.info));
+		break;
+	default:
+		str.Format(_T("%s,%s,%s,%d,%d,%s\r\n"),
+			CallExportType(call.type), CallExportCSV(call.name), CallExportCSV(call.number), call.time, call.duration, CallExportCSV(call.info));
+	}
+	segment->buffer->Append(MSIP::Utf8EncodeUni(str));
+	if (segment->buffer->GetLength() >= CALL_EXPORT_BUFFER) {
+		segment->output->Write(*segment->buffer, segment->buffer->GetLength());
+		segment->buffer->Empty();
+	}
+	data->records++;
+}
+
+bool CallExportRun(CallExport* data)
+{
+	data->records = 0;
+	CFile file;
+	CFileException fileException;
+	if (!file.Open(data->filename, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite, &fileException)) {
+		return false;
+	}
+	CStringA buffer;
+	buffer.Preallocate(CALL_EXPORT_BUFFER * 2);
+	switch (data->format) {
+	case MSIP_CALL_EXPORT_XML:
+		buffer = "<?xml version=\"1.0\"?>\r\n<calls>\r\n";
+		break;
+	case MSIP_CALL_EXPORT_NDJSON:
+		break;
+	default:
+		buffer = "\xEF\xBB\xBFType,Name,Number,Time,Duration,Info\r\n";
+	}
+	int monthFrom = data->timeFrom ? CallHistory::GetMonth(data->timeFrom) : 0;
+	int monthTo = data->timeTo ? CallHistory::GetMonth(data->timeTo - 1) : 0;
+	try {
+		for (int i = 0; i < data->months.GetCount(); i++) {
+			int month = data->months.GetAt(i);
+			if ((monthFrom && month < monthFrom) || (monthTo && month > monthTo)) {
+				continue;
+			}
+			CString filename;
+			filename.Format(_T("%s%06d.log"), data->path, month);
+			CallExportSegment segment;
+			segment.data = data;
+			segment.output = &file;
+			segment.buffer = &buffer;
+			// the first pass finds the last line of every record, the second writes
+			// those in file order; both read the same handle up to the same length,
+			// so neither appends nor a compaction meanwhile shift the records
+			CFile journal;
+			if (CallExportOpen(filename, &journal)) {
+				ULONGLONG end = journal.GetLength();
+				CallExportLines(&journal, end, CallExportCollect, &segment);
+				CallExportLines(&journal, end, CallExportRecord, &segment);
+				journal.Close();
+			}
+		}
+		if (data->format == MSIP_CALL_EXPORT_XML) {
+			buffer.Append("</calls>\r\n");
+		}
+		file.Write(buffer, buffer.GetLength());
+		file.Flush();
+	}
+	catch (CFileException *e) {
+		e->Delete();
+		file.Close();
+		return false;
+	}
+	file.Close();
+	return true;
+}
+
+static DWORD WINAPI CallExportThread(LPVOID lpParam)
+{
+	CallExport* data = (CallExport*)lpParam;
+	data->result = CallExportRun(data);
+	if (!data->hWnd || !::PostMessage(data->hWnd, data->message, 0, (LPARAM)data)) {
+		delete data;
+	}
+	return 0;
+}
+
+void CallExportAsync(CallExport* data)
+{
+	HANDLE thread = CreateThread(NULL, 0, CallExportThread, data, 0, NULL);
+	if (thread) {
+		CloseHandle(thread);
+	}
+	else {
+		CallExportThread(data);
+	}
+}
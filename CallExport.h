@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "global.h"
+
+enum {
+	MSIP_CALL_EXPORT_CSV,
+	MSIP_CALL_EXPORT_XML,
+	MSIP_CALL_EXPORT_NDJSON,
+};
+
+struct CallExport {
+	CString path;
+	// months to read, oldest first
+	CArray<int> months;
+	CString filename;
+	int format;
+	// time range, inclusive start and exclusive end, 0 for no limit
+	int timeFrom;
+	int timeTo;
+	HWND hWnd;
+	UINT message;
+	bool result;
+	int records;
+};
+
+// Writes the call history straight from the month journals, one journal at a time:
+// a first pass over a journal keeps the offset of the last line of every record, a
+// second streams those lines in file order through a fixed size output buffer, so
+// memory holds one key and offset per record of the largest month.
+// CallExportAsync runs on a worker thread and posts the CallExport to hWnd when done.
+void CallExportAsync(CallExport* data);
+bool CallExportRun(CallExport* data);
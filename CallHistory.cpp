@@ -0,0 +1,824 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "CallHistory.h"
+#include "settings.h"
+
+static int CallTimeCompare(const void* a, const void* b)
+{
+	// newest first
+	Call* pCall1 = *(Call**)a;
+	Call* pCall2 = *(Call**)b;
+	if (pCall1->time != pCall2->time) {
+		return pCall1->time > pCall2->time ? -1 : 1;
+	}
+	return pCall1->key > pCall2->key ? -1 : (pCall1->key < pCall2->key ? 1 : 0);
+}
+
+static int KeyCompare(const void* a, const void* b)
+{
+	int key1 = *(int*)a;
+	int key2 = *(int*)b;
+	return key1 > key2 ? 1 : (key1 < key2 ? -1 : 0);
+}
+
+static int SegmentCompare(const void* a, const void* b)
+{
+	CallHistorySegment* segment1 = *(CallHistorySegment**)a;
+	CallHistorySegment* segment2 = *(CallHistorySegment**)b;
+	return segment2->month - segment1->month;
+}
+
+CallHistory::CallHistory()
+{
+	updates = 0;
+	writerThread = NULL;
+	writerEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	idleEvent = CreateEvent(NULL, TRUE, TRUE, NULL);
+	writerStop = false;
+}
+
+CallHistory::~CallHistory()
+{
+	WriterStop();
+	CloseHandle(writerEvent);
+	CloseHandle(idleEvent);
+	Clear();
+}
+
+void CallHistory::Clear()
+{
+	for (int i = 0; i < calls.GetCount(); i++) {
+		delete calls.GetAt(i);
+	}
+	calls.RemoveAll();
+	ids.RemoveAll();
+	dirty.RemoveAll();
+	for (int i = 0; i < segments.GetCount(); i++) {
+		delete segments.GetAt(i);
+	}
+	segments.RemoveAll();
+}
+
+int CallHistory::GetMonth(int time)
+{
+	CTime timeCall(time);
+	return timeCall.GetYear() * 100 + timeCall.GetMonth();
+}
+
+CString CallHistory::SegmentFilename(CallHistorySegment* segment)
+{
+	CString filename;
+	filename.Format(_T("%s%06d.log"), path, segment->month);
+	return filename;
+}
+
+CallHistorySegment* CallHistory::SegmentGet(int month, bool create)
+{
+	int i;
+	for (i = 0; i < segments.GetCount(); i++) {
+		CallHistorySegment* segment = segments.GetAt(i);
+		if (segment->month == month) {
+			return segment;
+		}
+		if (segment->month < month) {
+			break;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+	CallHistorySegment* segment = new CallHistorySegment();
+	segment->month = month;
+	segment->loaded = true;
+	segments.InsertAt(i, segment);
+	return segment;
+}
+
+void CallHistory::Load()
+{
+	Flush();
+	Clear();
+	path = accountSettings.pathRoaming;
+	path.Append(_T("Calls\\"));
+	CreateDirectory(path, NULL);
+	WIN32_FIND_DATA findData;
+	HANDLE hFind = FindFirstFile(path + _T("*.log"), &findData);
+	if (hFind != INVALID_HANDLE_VALUE) {
+		do {
+			int month = _ttoi(findData.cFileName);
+			if (month > 190000 && month % 100 >= 1 && month % 100 <= 12) {
+				CallHistorySegment* segment = new CallHistorySegment();
+				segment->month = month;
+				segments.Add(segment);
+			}
+		} while (FindNextFile(hFind, &findData));
+		FindClose(hFind);
+	}
+	if (segments.GetCount()) {
+		qsort(segments.GetData(), segments.GetCount(), sizeof(CallHistorySegment*), SegmentCompare);
+	}
+	else {
+		Migrate();
+	}
+	if (segments.GetCount() && !segments.GetAt(0)->loaded) {
+		SegmentLoad(segments.GetAt(0));
+	}
+	WriterStart();
+}
+
+int CallHistory::LoadNext()
+{
+	for (int i = 0; i < segments.GetCount(); i++) {
+		CallHistorySegment* segment = segments.GetAt(i);
+		if (!segment->loaded) {
+			int count = calls.GetCount();
+			SegmentLoad(segment);
+			return calls.GetCount() - count;
+		}
+	}
+	return -1;
+}
+
+CString CallHistory::GetPath()
+{
+	return path;
+}
+
+void CallHistory::GetMonths(CArray<int>* months)
+{
+	// oldest first, with queued writes on disk
+	Flush();
+	for (int i = segments.GetCount() - 1; i >= 0; i--) {
+		months->Add(segments.GetAt(i)->month);
+	}
+}
+
+void CallHistory::ForEach(CallHistoryProc proc, void* param)
+{
+	// reads every month from disk, oldest first, without keeping it loaded
+	Flush();
+	for (int i = segments.GetCount() - 1; i >= 0; i--) {
+		CallHistorySegment segment;
+		segment.month = segments.GetAt(i)->month;
+		CFile file;
+		CFileException fileException;
+		if (!file.Open(SegmentFilename(&segment), CFile::modeRead | CFile::shareDenyWrite, &fileException)) {
+			continue;
+		}
+		UINT len = (UINT)file.GetLength();
+		CStringA data;
+		if (len) {
+			LPSTR p = data.GetBuffer(len);
+			len = file.Read(p, len);
+			data.ReleaseBuffer(len);
+		}
+		file.Close();
+		Parse(&segment, data, data.GetLength());
+		POSITION pos = segment.keys.GetStartPosition();
+		while (pos) {
+			int key;
+			Call* pCall;
+			segment.keys.GetNextAssoc(pos, key, pCall);
+			proc(pCall, param);
+			delete pCall;
+		}
+	}
+}
+
+bool CallHistory::HasMore()
+{
+	return segments.GetCount() && !segments.GetAt(segments.GetCount() - 1)->loaded;
+}
+
+bool CallHistory::Trim()
+{
+	// keep the newest segment and anything a call in progress may still update
+	int month = GetMonth(CTime::GetCurrentTime().GetTime() - 86400);
+	bool trimmed = false;
+	for (int i = 1; i < segments.GetCount(); i++) {
+		CallHistorySegment* segment = segments.GetAt(i);
+		if (segment->loaded && segment->month < month) {
+			segment->loaded = false;
+			segment->records = 0;
+			segment->lastKey = -1;
+			segment->keys.RemoveAll();
+			trimmed = true;
+		}
+	}
+	if (trimmed) {
+		int j = 0;
+		for (int i = 0; i < calls.GetCount(); i++) {
+			Call* pCall = calls.GetAt(i);
+			CallHistorySegment* segment = SegmentGet(GetMonth(pCall->time));
+			if (segment && segment->loaded) {
+				calls.SetAt(j++, pCall);
+			}
+			else {
+				if (!pCall->id.IsEmpty()) {
+					ids.RemoveKey(pCall->id);
+				}
+				delete pCall;
+			}
+		}
+		calls.SetSize(j);
+	}
+	return trimmed;
+}
+
+void CallHistory::SegmentLoad(CallHistorySegment* segment)
+{
+	// the file may still have queued appends
+	Flush();
+	segment->loaded = true;
+	segment->records = 0;
+	CFile file;
+	CFileException fileException;
+	if (file.Open(SegmentFilename(segment), CFile::modeRead | CFile::shareDenyWrite, &fileException)) {
+		UINT len = (UINT)file.GetLength();
+		CStringA data;
+		if (len) {
+			LPSTR p = data.GetBuffer(len);
+			len = file.Read(p, len);
+			data.ReleaseBuffer(len);
+		}
+		file.Close();
+		Parse(segment, data, data.GetLength());
+	}
+	// the segment is older than everything loaded so far
+	int start = calls.GetCount();
+	int count = start;
+	calls.SetSize(start + segment->keys.GetCount());
+	POSITION pos = segment->keys.GetStartPosition();
+	while (pos) {
+		int key;
+		Call* pCall;
+		segment->keys.GetNextAssoc(pos, key, pCall);
+		calls.SetAt(count++, pCall);
+		if (key > segment->lastKey) {
+			segment->lastKey = key;
+		}
+	}
+	if (count > start) {
+		qsort(calls.GetData() + start, count - start, sizeof(Call*), CallTimeCompare);
+	}
+	if (segment->records > segment->keys.GetCount() * 2 + 64) {
+		Compact(segment);
+	}
+}
+
+void CallHistory::Parse(CallHistorySegment* segment, const char* data, int len)
+{
+	const char* p = data;
+	const char* end = data + len;
+	while (p < end) {
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol) {
+			// incomplete tail left by an interrupted write
+			break;
+		}
+		const char* lineEnd = eol;
+		if (lineEnd > p && *(lineEnd - 1) == '\r') {
+			lineEnd--;
+		}
+		const char* sep = (const char*)memchr(p, '=', lineEnd - p);
+		if (sep && sep > p) {
+			int key = atoi(CStringA(p, (int)(sep - p)));
+			Apply(segment, key, MSIP::Utf8DecodeUni(sep + 1, (int)(lineEnd - sep - 1)));
+		}
+		p = eol + 1;
+	}
+}
+
+void CallHistory::Apply(CallHistorySegment* segment, int key, CString value)
+{
+	segment->records++;
+	Call* pCall = NULL;
+	segment->keys.Lookup(key, pCall);
+	if (value == _T("null")) {
+		if (pCall) {
+			segment->keys.RemoveKey(key);
+			delete pCall;
+		}
+		return;
+	}
+	if (!pCall) {
+		pCall = new Call();
+		segment->keys.SetAt(key, pCall);
+	}
+	CallDecode(value, pCall);
+	pCall->key = key;
+}
+
+void CallHistory::Migrate()
+{
+	// older storage: single Calls.log journal or one INI key per record in [Calls]
+	CallHistorySegment legacy;
+	CString filename = accountSettings.pathRoaming;
+	filename.Append(_T("Calls.log"));
+	bool fromJournal = false;
+	CFile file;
+	CFileException fileException;
+	if (file.Open(filename, CFile::modeRead | CFile::shareDenyWrite, &fileException)) {
+		UINT len = (UINT)file.GetLength();
+		CStringA data;
+		if (len) {
+			LPSTR p = data.GetBuffer(len);
+			len = file.Read(p, len);
+			data.ReleaseBuffer(len);
+		}
+		file.Close();
+		Parse(&legacy, data, data.GetLength());
+		fromJournal = true;
+	}
+	else if (MSIP::IniSectionExists(_T("Calls"), accountSettings.iniFile)) {
+		CString section;
+		DWORD size = 65536;
+		LPTSTR ptr;
+		while (true) {
+			ptr = section.GetBuffer(size);
+			DWORD res = GetPrivateProfileSection(_T("Calls"), ptr, size, accountSettings.iniFile);
+			if (res < size - 2) {
+				break;
+			}
+			section.ReleaseBuffer(0);
+			size *= 2;
+		}
+		LPCTSTR p = ptr;
+		while (*p) {
+			int len = _tcslen(p);
+			LPCTSTR sep = _tcschr(p, '=');
+			if (sep && sep > p) {
+				int key = _ttoi(CString(p, (int)(sep - p)));
+				Apply(&legacy, key, CString(sep + 1));
+			}
+			p += len + 1;
+		}
+		section.ReleaseBuffer(0);
+	}
+	else {
+		return;
+	}
+	CArray<Call*> legacyCalls;
+	POSITION pos = legacy.keys.GetStartPosition();
+	while (pos) {
+		int key;
+		Call* pCall;
+		legacy.keys.GetNextAssoc(pos, key, pCall);
+		legacyCalls.Add(pCall);
+	}
+	legacy.keys.RemoveAll();
+	if (legacyCalls.GetCount()) {
+		qsort(legacyCalls.GetData(), legacyCalls.GetCount(), sizeof(Call*), CallTimeCompare);
+	}
+	// oldest first so keys follow call order
+	for (int i = legacyCalls.GetCount() - 1; i >= 0; i--) {
+		Call* pCall = legacyCalls.GetAt(i);
+		CallHistorySegment* segment = SegmentGet(GetMonth(pCall->time), true);
+		pCall->key = ++segment->lastKey;
+		segment->keys.SetAt(pCall->key, pCall);
+	}
+	bool ok = true;
+	for (int i = 0; i < segments.GetCount(); i++) {
+		if (!SegmentWrite(segments.GetAt(i))) {
+			ok = false;
+		}
+	}
+	// migrated records are reloaded segment by segment like any other history
+	for (int i = 0; i < segments.GetCount(); i++) {
+		CallHistorySegment* segment = segments.GetAt(i);
+		POSITION pos = segment->keys.GetStartPosition();
+		while (pos) {
+			int key;
+			Call* pCall;
+			segment->keys.GetNextAssoc(pos, key, pCall);
+			delete pCall;
+		}
+		segment->keys.RemoveAll();
+		segment->loaded = false;
+		segment->records = 0;
+		segment->lastKey = -1;
+	}
+	if (ok) {
+		if (fromJournal) {
+			DeleteFile(filename);
+		}
+		else {
+			WritePrivateProfileSection(_T("Calls"), NULL, accountSettings.iniFile);
+			WritePrivateProfileString(_T("Settings"), _T("callsLastKey"), NULL, accountSettings.iniFile);
+		}
+	}
+}
+
+bool CallHistory::SegmentWrite(CallHistorySegment* segment)
+{
+	CString filename = SegmentFilename(segment);
+	CString tmp = filename + _T(".tmp");
+	CFile file;
+	CFileException fileException;
+	if (!file.Open(tmp, CFile::modeCreate | CFile::modeWrite, &fileException)) {
+		return false;
+	}
+	CStringA data;
+	POSITION pos = segment->keys.GetStartPosition();
+	while (pos) {
+		int key;
+		Call* pCall;
+		segment->keys.GetNextAssoc(pos, key, pCall);
+		CString line;
+		line.Format(_T("%d=%s\n"), key, CallEncode(pCall));
+		data.Append(MSIP::Utf8EncodeUni(line));
+		if (data.GetLength() > 65536) {
+			file.Write(data, data.GetLength());
+			data.Empty();
+		}
+	}
+	file.Write(data, data.GetLength());
+	file.Flush();
+	file.Close();
+	if (!MoveFileEx(tmp, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFile(tmp);
+		return false;
+	}
+	segment->records = segment->keys.GetCount();
+	return true;
+}
+
+void CallHistory::JournalWrite(CallHistorySegment* segment, const CStringA& data)
+{
+	CallHistoryWrite* write = new CallHistoryWrite();
+	write->filename = SegmentFilename(segment);
+	write->compact = false;
+	write->replace = false;
+	write->data = data;
+	Enqueue(write);
+	segment->records++;
+	if (segment->records > segment->keys.GetCount() * 2 + 64) {
+		Compact(segment);
+	}
+}
+
+void CallHistory::Compact(CallHistorySegment* segment)
+{
+	CallHistoryWrite* write = new CallHistoryWrite();
+	write->filename = SegmentFilename(segment);
+	write->compact = true;
+	write->replace = false;
+	Enqueue(write);
+	segment->records = segment->keys.GetCount();
+}
+
+void CallHistory::Enqueue(CallHistoryWrite* write)
+{
+	pendingCS.Lock();
+	pending.AddTail(write);
+	ResetEvent(idleEvent);
+	pendingCS.Unlock();
+	if (writerThread) {
+		SetEvent(writerEvent);
+	}
+	else {
+		WriterRun();
+	}
+}
+
+void CallHistory::FileSave(CString filename, const CStringA& data)
+{
+	CallHistoryWrite* write = new CallHistoryWrite();
+	write->filename = path + filename;
+	write->compact = false;
+	write->replace = true;
+	write->data = data;
+	Enqueue(write);
+}
+
+void CallHistory::Flush()
+{
+	if (writerThread) {
+		WaitForSingleObject(idleEvent, INFINITE);
+	}
+}
+
+void CallHistory::WriterStart()
+{
+	if (!writerThread) {
+		writerStop = false;
+		writerThread = CreateThread(NULL, 0, WriterThread, this, 0, NULL);
+	}
+}
+
+void CallHistory::WriterStop()
+{
+	if (writerThread) {
+		pendingCS.Lock();
+		writerStop = true;
+		pendingCS.Unlock();
+		SetEvent(writerEvent);
+		WaitForSingleObject(writerThread, INFINITE);
+		CloseHandle(writerThread);
+		writerThread = NULL;
+	}
+}
+
+DWORD WINAPI CallHistory::WriterThread(LPVOID lpParam)
+{
+	CallHistory* history = (CallHistory*)lpParam;
+	do {
+		WaitForSingleObject(history->writerEvent, INFINITE);
+	} while (history->WriterRun());
+	return 0;
+}
+
+bool CallHistory::WriterRun()
+{
+	// drains the queue, returns false once stopped
+	while (true) {
+		pendingCS.Lock();
+		if (pending.IsEmpty()) {
+			SetEvent(idleEvent);
+			bool stop = writerStop;
+			pendingCS.Unlock();
+			return !stop;
+		}
+		CallHistoryWrite* write = pending.RemoveHead();
+		// coalesce consecutive appends to the same journal into one write and flush
+		while (!write->compact && !write->replace && !pending.IsEmpty()) {
+			CallHistoryWrite* next = pending.GetHead();
+			if (next->compact || next->replace || next->filename != write->filename) {
+				break;
+			}
+			write->data.Append(next->data);
+			pending.RemoveHead();
+			delete next;
+		}
+		pendingCS.Unlock();
+		if (write->compact) {
+			JournalCompact(write->filename);
+		}
+		else if (write->replace) {
+			MSIP::FileReplace(write->filename, write->data);
+		}
+		else {
+			JournalAppend(write->filename, write->data);
+		}
+		delete write;
+	}
+}
+
+void CallHistory::JournalAppend(CString filename, const CStringA& data)
+{
+	CFile file;
+	CFileException fileException;
+	if (!file.Open(filename, CFile::modeCreate | CFile::modeNoTruncate | CFile::modeReadWrite | CFile::shareDenyWrite, &fileException)) {
+		return;
+	}
+	try {
+		ULONGLONG len = file.GetLength();
+		if (len) {
+			// terminate a line torn by an interrupted write so it cannot swallow ours
+			char last = 0;
+			file.Seek(len - 1, CFile::begin);
+			file.Read(&last, 1);
+			if (last != '\n') {
+				file.Write("\n", 1);
+			}
+		}
+		file.SeekToEnd();
+		file.Write(data, data.GetLength());
+		file.Flush();
+	}
+	catch (CFileException *e) {
+		e->Delete();
+	}
+	file.Close();
+}
+
+bool CallHistory::JournalCompact(CString filename)
+{
+	CFile file;
+	CFileException fileException;
+	if (!file.Open(filename, CFile::modeRead | CFile::shareDenyWrite, &fileException)) {
+		return false;
+	}
+	UINT len = (UINT)file.GetLength();
+	CStringA data;
+	if (len) {
+		LPSTR p = data.GetBuffer(len);
+		len = file.Read(p, len);
+		data.ReleaseBuffer(len);
+	}
+	file.Close();
+	// last line per key wins, "null" drops the key
+	CMap<int, int, CStringA, const CStringA&> lines;
+	const char* p = data;
+	const char* end = p + data.GetLength();
+	while (p < end) {
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol) {
+			break;
+		}
+		const char* sep = (const char*)memchr(p, '=', eol - p);
+		if (sep && sep > p) {
+			int key = atoi(CStringA(p, (int)(sep - p)));
+			CStringA line(p, (int)(eol - p + 1));
+			if (line.Mid((int)(sep - p) + 1).TrimRight() == "null") {
+				lines.RemoveKey(key);
+			}
+			else {
+				lines.SetAt(key, line);
+			}
+		}
+		p = eol + 1;
+	}
+	// records in key order, which is the order they were added in
+	CArray<int> keys;
+	POSITION pos = lines.GetStartPosition();
+	while (pos) {
+		int key;
+		CStringA line;
+		lines.GetNextAssoc(pos, key, line);
+		keys.Add(key);
+	}
+	if (keys.GetCount()) {
+		qsort(keys.GetData(), keys.GetCount(), sizeof(int), KeyCompare);
+	}
+	data.Empty();
+	for (int i = 0; i < keys.GetCount(); i++) {
+		data.Append(lines[keys.GetAt(i)]);
+	}
+	return MSIP::FileReplace(filename, data);
+}
+
+void CallHistory::Add(Call* pCall)
+{
+	CallHistorySegment* segment = SegmentGet(GetMonth(pCall->time), true);
+	if (!segment->loaded) {
+		SegmentLoad(segment);
+	}
+	pCall->key = ++segment->lastKey;
+	segment->keys.SetAt(pCall->key, pCall);
+	calls.InsertAt(0, pCall);
+	if (!pCall->id.IsEmpty()) {
+		ids.SetAt(pCall->id, pCall);
+	}
+	Save(pCall);
+}
+
+Call* CallHistory::Find(CString id)
+{
+	void* pCall;
+	if (ids.Lookup(id, pCall)) {
+		return (Call*)pCall;
+	}
+	return NULL;
+}
+
+void CallHistory::BeginUpdate()
+{
+	updates++;
+}
+
+void CallHistory::EndUpdate()
+{
+	if (updates && !--updates) {
+		while (!dirty.IsEmpty()) {
+			Save(dirty.RemoveHead());
+		}
+	}
+}
+
+void CallHistory::Save(Call* pCall)
+{
+	if (updates) {
+		if (!dirty.Find(pCall)) {
+			dirty.AddTail(pCall);
+		}
+		return;
+	}
+	CallHistorySegment* segment = SegmentGet(GetMonth(pCall->time));
+	if (segment) {
+		CString line;
+		line.Format(_T("%d=%s\n"), pCall->key, CallEncode(pCall));
+		JournalWrite(segment, MSIP::Utf8EncodeUni(line));
+	}
+}
+
+void CallHistory::Delete(Call* pCall)
+{
+	for (int i = 0; i < calls.GetCount(); i++) {
+		if (calls.GetAt(i) == pCall) {
+			calls.RemoveAt(i);
+			break;
+		}
+	}
+	POSITION pos = dirty.Find(pCall);
+	if (pos) {
+		dirty.RemoveAt(pos);
+	}
+	void* pCallId;
+	if (!pCall->id.IsEmpty() && ids.Lookup(pCall->id, pCallId) && pCallId == pCall) {
+		ids.RemoveKey(pCall->id);
+	}
+	CallHistorySegment* segment = SegmentGet(GetMonth(pCall->time));
+	if (segment) {
+		segment->keys.RemoveKey(pCall->key);
+		CString line;
+		line.Format(_T("%d=null\n"), pCall->key);
+		JournalWrite(segment, CStringA(line));
+	}
+	delete pCall;
+}
+
+void CallHistory::DeleteAll()
+{
+	Flush();
+	for (int i = 0; i < segments.GetCount(); i++) {
+		DeleteFile(SegmentFilename(segments.GetAt(i)));
+	}
+	Clear();
+}
+
+CString CallHistory::CallEncode(Call* pCall)
+{
+	CString data;
+	data.Format(_T("%s;%s;%d;%d;%d;%s"), pCall->number, pCall->name, pCall->type, pCall->time, pCall->duration, pCall->info);
+	// one record per journal line
+	data.Replace('\r', ' ');
+	data.Replace('\n', ' ');
+	return data;
+}
+
+void CallHistory::CallDecode(CString str, Call* pCall)
+{
+	pCall->number = str;
+	pCall->name = pCall->number;
+	pCall->type = 0;
+	pCall->time = 0;
+	pCall->duration = 0;
+	pCall->info.Empty();
+
+	CString rab;
+	int begin;
+	int end;
+	begin = 0;
+	end = str.Find(';', begin);
+
+	if (end != -1)
+	{
+		pCall->number = str.Mid(begin, end - begin);
+		begin = end + 1;
+		end = str.Find(';', begin);
+		if (end != -1)
+		{
+			pCall->name = str.Mid(begin, end - begin);
+			begin = end + 1;
+			end = str.Find(';', begin);
+			if (end != -1)
+			{
+				pCall->type = atoi(CStringA(str.Mid(begin, end - begin)));
+				if (pCall->type > 3 || pCall->type < 0) {
+					pCall->type = 0;
+				}
+				begin = end + 1;
+				end = str.Find(';', begin);
+				if (end != -1)
+				{
+					pCall->time = atoi(CStringA(str.Mid(begin, end - begin)));
+					begin = end + 1;
+					end = str.Find(';', begin);
+					if (end != -1)
+					{
+						pCall->duration = atoi(CStringA(str.Mid(begin, end - begin)));
+						begin = end + 1;
+						end = str.Find(';', begin);
+						if (end != -1)
+						{
+							pCall->info = str.Mid(begin, end - begin);
+							begin = end + 1;
+							end = str.Find(';', begin);
+						}
+						else {
+							pCall->info = str.Mid(begin);
+						}
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "global.h"
+
+struct CallHistorySegment {
+	int month;
+	bool loaded;
+	int records;
+	int lastKey;
+	CMap<int, int, Call*, Call*> keys;
+	CallHistorySegment() : month(0)
+		, loaded(false)
+		, records(0)
+		, lastKey(-1)
+	{}
+};
+
+struct CallHistoryWrite {
+	CString filename;
+	bool compact;
+	bool replace;
+	CStringA data;
+};
+
+typedef void (*CallHistoryProc)(Call* pCall, void* param);
+
+// Call log storage.
+// History is split into one append-only journal per month (Calls\YYYYMM.log).
+// A journal holds "key=value" lines in the encoding the old INI [Calls] section used,
+// keys are unique within the segment, the last line for a key wins and "null" marks
+// a deleted record. Only the newest segment is read at startup, older ones are
+// loaded on demand with LoadNext() and dropped again with Trim().
+// Journal writes are queued to a writer thread which appends and flushes them in
+// batches; BeginUpdate()/EndUpdate() collapse several Save() calls into one line.
+class CallHistory
+{
+public:
+	CallHistory();
+	~CallHistory();
+
+	// records of the loaded segments, newest first
+	CArray<Call*> calls;
+
+	void Load();
+	int LoadNext();
+	bool HasMore();
+	CString GetPath();
+	void GetMonths(CArray<int>* months);
+	void ForEach(CallHistoryProc proc, void* param);
+	void FileSave(CString filename, const CStringA& data);
+	bool Trim();
+	void Add(Call* pCall);
+	Call* Find(CString id);
+	void BeginUpdate();
+	void EndUpdate();
+	void Save(Call* pCall);
+	void Delete(Call* pCall);
+	void DeleteAll();
+	void Flush();
+
+	static CString CallEncode(Call* pCall);
+	static void CallDecode(CString str, Call* pCall);
+	static int GetMonth(int time);
+
+private:
+	CString path;
+	// newest first, loaded segments always precede unloaded ones
+	CArray<CallHistorySegment*> segments;
+	// SIP Call-ID to record, for calls added in this session
+	CMapStringToPtr ids;
+	// records changed inside BeginUpdate()/EndUpdate()
+	int updates;
+	CList<Call*> dirty;
+
+	// writer thread state, pending is guarded by pendingCS
+	CList<CallHistoryWrite*> pending;
+	CCriticalSection pendingCS;
+	HANDLE writerThread;
+	HANDLE writerEvent;
+	HANDLE idleEvent;
+	bool writerStop;
+
+	void Clear();
+	CallHistorySegment* SegmentGet(int month, bool create = false);
+	CString SegmentFilename(CallHistorySegment* segment);
+	void SegmentLoad(CallHistorySegment* segment);
+	void Parse(CallHistorySegment* segment, const char* data, int len);
+	void Apply(CallHistorySegment* segment, int key, CString value);
+	void Migrate();
+	bool SegmentWrite(CallHistorySegment* segment);
+	void Compact(CallHistorySegment* segment);
+	void JournalWrite(CallHistorySegment* segment, const CStringA& data);
+	void Enqueue(CallHistoryWrite* write);
+	void WriterStart();
+	void WriterStop();
+	bool WriterRun();
+	static DWORD WINAPI WriterThread(LPVOID lpParam);
+	static void JournalAppend(CString filename, const CStringA& data);
+	static bool JournalCompact(CString filename);
+};
@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "CallStats.h"
+
+CallStats::CallStats()
+{
+	dirty = false;
+}
+
+CallStats::~CallStats()
+{
+	RemoveAll();
+}
+
+void CallStats::RemoveAll()
+{
+	POSITION pos = entries.GetStartPosition();
+	while (pos) {
+		CString number;
+		CallStatsEntry* entry;
+		entries.GetNextAssoc(pos, number, entry);
+		delete entry;
+	}
+	entries.RemoveAll();
+	for (int r = 0; r < MSIP_CALL_STATS_COUNT; r++) {
+		order[r].RemoveAll();
+		buckets[r].RemoveAll();
+	}
+	dirty = true;
+}
+
+int& CallStats::Value(CallStatsEntry* entry, int ranking)
+{
+	return ranking == MSIP_CALL_STATS_MISSED ? entry->missed : entry->calls;
+}
+
+CallStatsEntry* CallStats::Get(CString number)
+{
+	CallStatsEntry* entry;
+	if (entries.Lookup(number, entry)) {
+		return entry;
+	}
+	return NULL;
+}
+
+void CallStats::Swap(int ranking, int i, int j)
+{
+	if (i != j) {
+		CallStatsEntry* entry1 = order[ranking].GetAt(i);
+		CallStatsEntry* entry2 = order[ranking].GetAt(j);
+		order[ranking].SetAt(i, entry2);
+		order[ranking].SetAt(j, entry1);
+		entry1->rank[ranking] = j;
+		entry2->rank[ranking] = i;
+	}
+}
+
+void CallStats::Increment(CallStatsEntry* entry, int ranking)
+{
+	// move to the head of its bucket, which then becomes the tail of the next one
+	int& value = Value(entry, ranking);
+	CallStatsBucket bucket;
+	buckets[ranking].Lookup(value, bucket);
+	int i = bucket.first;
+	Swap(ranking, entry->rank[ranking], i);
+	if (bucket.first == bucket.last) {
+		buckets[ranking].RemoveKey(value);
+	}
+	else {
+		bucket.first++;
+		buckets[ranking].SetAt(value, bucket);
+	}
+	value++;
+	if (buckets[ranking].Lookup(value, bucket)) {
+		bucket.last = i;
+	}
+	else {
+		bucket.first = bucket.last = i;
+	}
+	buckets[ranking].SetAt(value, bucket);
+}
+
+void CallStats::Decrement(CallStatsEntry* entry, int ranking)
+{
+	int& value = Value(entry, ranking);
+	CallStatsBucket bucket;
+	buckets[ranking].Lookup(value, bucket);
+	int i = bucket.last;
+	Swap(ranking, entry->rank[ranking], i);
+	if (bucket.first == bucket.last) {
+		buckets[ranking].RemoveKey(value);
+	}
+	else {
+		bucket.last--;
+		buckets[ranking].SetAt(value, bucket);
+	}
+	value--;
+	if (buckets[ranking].Lookup(value, bucket)) {
+		bucket.first = i;
+	}
+	else {
+		bucket.first = bucket.last = i;
+	}
+	buckets[ranking].SetAt(value, bucket);
+}
+
+void CallStats::Add(Call* pCall)
+{
+	if (pCall->number.IsEmpty()) {
+		return;
+	}
+	CallStatsEntry* entry = Get(pCall->number);
+	if (!entry) {
+		entry = new CallStatsEntry();
+		entry->number = pCall->number;
+		entry->calls = 0;
+		entry->missed = 0;
+		entry->duration = 0;
+		entry->lastTime = 0;
+		entries.SetAt(entry->number, entry);
+		for (int r = 0; r < MSIP_CALL_STATS_COUNT; r++) {
+			// zero is always the last bucket
+			int i = order[r].Add(entry);
+			entry->rank[r] = i;
+			CallStatsBucket bucket;
+			if (!buckets[r].Lookup(0, bucket)) {
+				bucket.first = i;
+			}
+			bucket.last = i;
+			buckets[r].SetAt(0, bucket);
+		}
+	}
+	Increment(entry, MSIP_CALL_STATS_CALLS);
+	if (pCall->type == MSIP_CALL_MISS) {
+		Increment(entry, MSIP_CALL_STATS_MISSED);
+	}
+	entry->duration += pCall->duration;
+	if (pCall->time >= entry->lastTime) {
+		entry->lastTime = pCall->time;
+		entry->name = pCall->name;
+	}
+	dirty = true;
+}
+
+void CallStats::Remove(Call* pCall)
+{
+	CallStatsEntry* entry = Get(pCall->number);
+	if (!entry) {
+		return;
+	}
+	if (pCall->type == MSIP_CALL_MISS && entry->missed > 0) {
+		Decrement(entry, MSIP_CALL_STATS_MISSED);
+	}
+	if (entry->calls > 0) {
+		Decrement(entry, MSIP_CALL_STATS_CALLS);
+	}
+	entry->duration -= pCall->duration;
+	if (entry->duration < 0) {
+		entry->duration = 0;
+	}
+	dirty = true;
+	if (entry->calls) {
+		return;
+	}
+	while (entry->missed) {
+		Decrement(entry, MSIP_CALL_STATS_MISSED);
+	}
+	// no calls left, the entry sits in the zero bucket of every ranking: swap it out of the tail
+	for (int r = 0; r < MSIP_CALL_STATS_COUNT; r++) {
+		int last = order[r].GetCount() - 1;
+		Swap(r, entry->rank[r], last);
+		order[r].SetSize(last);
+		CallStatsBucket bucket;
+		buckets[r].Lookup(0, bucket);
+		if (bucket.first == bucket.last) {
+			buckets[r].RemoveKey(0);
+		}
+		else {
+			bucket.last--;
+			buckets[r].SetAt(0, bucket);
+		}
+	}
+	entries.RemoveKey(entry->number);
+	delete entry;
+}
+
+int CallStats::GetTop(int ranking, int k, CArray<CallStatsEntry*>* top)
+{
+	top->RemoveAll();
+	int count = min(k, order[ranking].GetCount());
+	for (int i = 0; i < count; i++) {
+		CallStatsEntry* entry = order[ranking].GetAt(i);
+		if (!Value(entry, ranking)) {
+			break;
+		}
+		top->Add(entry);
+	}
+	return top->GetCount();
+}
+
+static int __cdecl RankCompare(void* context, const void* a, const void* b)
+{
+	int ranking = *(int*)context;
+	CallStatsEntry* entry1 = *(CallStatsEntry**)a;
+	CallStatsEntry* entry2 = *(CallStatsEntry**)b;
+	int value1 = ranking == MSIP_CALL_STATS_MISSED ? entry1->missed : entry1->calls;
+	int value2 = ranking == MSIP_CALL_STATS_MISSED ? entry2->missed : entry2->calls;
+	return value2 - value1;
+}
+
+void CallStats::Rank()
+{
+	// full ordering, only needed after Load
+	for (int r = 0; r < MSIP_CALL_STATS_COUNT; r++) {
+		order[r].RemoveAll();
+		buckets[r].RemoveAll();
+		POSITION pos = entries.GetStartPosition();
+		while (pos) {
+			CString number;
+			CallStatsEntry* entry;
+			entries.GetNextAssoc(pos, number, entry);
+			order[r].Add(entry);
+		}
+		qsort_s(order[r].GetData(), order[r].GetCount(), sizeof(CallStatsEntry*), RankCompare, &r);
+		for (int i = 0; i < order[r].GetCount(); i++) {
+			CallStatsEntry* entry = order[r].GetAt(i);
+			entry->rank[r] = i;
+			CallStatsBucket bucket;
+			int value = Value(entry, r);
+			if (!buckets[r].Lookup(value, bucket)) {
+				bucket.first = i;
+			}
+			bucket.last = i;
+			buckets[r].SetAt(value, bucket);
+		}
+	}
+}
+
+bool CallStats::Load(CString filename)
+{
+	CFile file;
+	CFileException fileException;
+	if (!file.Open(filename, CFile::modeRead | CFile::shareDenyWrite, &fileException)) {
+		return false;
+	}
+	UINT len = (UINT)file.GetLength();
+	CStringA data;
+	if (len) {
+		LPSTR p = data.GetBuffer(len);
+		len = file.Read(p, len);
+		data.ReleaseBuffer(len);
+	}
+	file.Close();
+	RemoveAll();
+	// calls, missed, duration, last time, number and name per line, tab separated
+	const char* p = data;
+	const char* end = p + data.GetLength();
+	while (p < end) {
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		if (!eol) {
+			break;
+		}
+		CString line = MSIP::Utf8DecodeUni(p, (int)(eol - p));
+		p = eol + 1;
+		int values[4];
+		int begin = 0;
+		int i;
+		for (i = 0; i < 4; i++) {
+			int sep = line.Find('\t', begin);
+			if (sep == -1) {
+				break;
+			}
+			values[i] = _ttoi(line.Mid(begin, sep - begin));
+			begin = sep + 1;
+		}
+		int sep = line.Find('\t', begin);
+		if (i < 4 || sep <= begin || values[0] <= 0) {
+			continue;
+		}
+		CallStatsEntry* entry = new CallStatsEntry();
+		entry->calls = values[0];
+		entry->missed = min(values[1], values[0]);
+		entry->duration = values[2];
+		entry->lastTime = values[3];
+		entry->number = line.Mid(begin, sep - begin);
+		entry->name = line.Mid(sep + 1);
+		CallStatsEntry* existing;
+		if (entries.Lookup(entry->number, existing)) {
+			delete existing;
+		}
+		entries.SetAt(entry->number, entry);
+	}
+	Rank();
+	dirty = false;
+	return true;
+}
+
+CStringA CallStats::Encode()
+{
+	CStringA data;
+	POSITION pos = entries.GetStartPosition();
+	while (pos) {
+		CString number;
+		CallStatsEntry* entry;
+		entries.GetNextAssoc(pos, number, entry);
+		CString name = entry->name;
+		name.Replace('\r', ' ');
+		name.Replace('\n', ' ');
+		name.Replace('\t', ' ');
+		CString line;
+		line.Format(_T("%d\t%d\t%d\t%d\t%s\t%s\n"), entry->calls, entry->missed, entry->duration, entry->lastTime, entry->number, name);
+		data.Append(MSIP::Utf8EncodeUni(line));
+	}
+	dirty = false;
+	return data;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "global.h"
+
+enum {
+	MSIP_CALL_STATS_CALLS,
+	MSIP_CALL_STATS_MISSED,
+	MSIP_CALL_STATS_COUNT
+};
+
+struct CallStatsEntry {
+	CString number;
+	CString name;
+	int calls;
+	int missed;
+	int duration;
+	int lastTime;
+	int rank[MSIP_CALL_STATS_COUNT];
+};
+
+struct CallStatsBucket {
+	int first;
+	int last;
+};
+
+// Per-number call totals.
+// Every ranking keeps its entries ordered by count, with the index range of each
+// count in buckets, so a count moves by one with a single swap and the top k
+// entries are the first k of the array.
+class CallStats
+{
+public:
+	CallStats();
+	~CallStats();
+
+	bool dirty;
+
+	void Add(Call* pCall);
+	void Remove(Call* pCall);
+	CallStatsEntry* Get(CString number);
+	int GetTop(int ranking, int k, CArray<CallStatsEntry*>* top);
+	void RemoveAll();
+	bool Load(CString filename);
+	CStringA Encode();
+
+private:
+	CMap<CString, LPCTSTR, CallStatsEntry*, CallStatsEntry*> entries;
+	CArray<CallStatsEntry*> order[MSIP_CALL_STATS_COUNT];
+	CMap<int, int, CallStatsBucket, CallStatsBucket&> buckets[MSIP_CALL_STATS_COUNT];
+
+	static int& Value(CallStatsEntry* entry, int ranking);
+	void Swap(int ranking, int i, int j);
+	void Increment(CallStatsEntry* entry, int ranking);
+	void Decrement(CallStatsEntry* entry, int ranking);
+	void Rank();
+};
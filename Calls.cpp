@@ -44,6 +44,13 @@ Calls::Calls(CWnd* pParent /*=NULL*/)
 
 Calls::~Calls(void)
 {
+	StatsSave();
+	StatsViewClear();
+}
+
+static void CallsSortRows(int columnIndex, bool ascending, void* param)
+{
+	((Calls*)param)->SortRows(columnIndex, ascending);
 }
 
 BOOL Calls::OnInitDialog()
@@ -70,6 +77,7 @@ BOOL Calls::OnInitDialog()
 	//list->SetExtendedStyle( list->GetExtendedStyle() |  LVS_EX_FULLROWSELECT | LVS_EX_AUTOSIZECOLUMNS);
 	list->SetExtendedStyle(list->GetExtendedStyle() | LVS_EX_FULLROWSELECT);
 	list->SetImageList(imageList, LVSIL_SMALL);
+	m_SortItemsExListCtrl.SetSortRowsProc(CallsSortRows, this);
 
 	CFont* font = list->GetFont();
 	LOGFONT lf;
@@ -85,7 +93,12 @@ BOOL Calls::OnInitDialog()
 	list->InsertColumn(MSIP_CALLS_COL_DURATION, Translate(_T("Duration")), LVCFMT_LEFT, accountSettings.callsWidth3 > 0 ? accountSettings.callsWidth3 : 70);
 	list->InsertColumn(MSIP_CALLS_COL_INFO, Translate(_T("Info")), LVCFMT_LEFT, accountSettings.callsWidth4 > 0 ? accountSettings.callsWidth4 : 120);
 
+	history.Load();
+	SearchIndexAppend(0);
+	statsView = -1;
+	StatsLoad();
 	CallsLoad();
+	CallsLoadVisible();
 
 	SetTimer(IDT_TIMER_CALLS, 300 * 1000, NULL);
 
@@ -114,6 +127,7 @@ void Calls::DoDataExchange(CDataExchange* pDX)
 void Calls::OnTimer(UINT_PTR TimerVal)
 {
 	ReloadTime();
+	StatsSave();
 }
 
 
@@ -130,8 +144,14 @@ BEGIN_MESSAGE_MAP(Calls, CBaseDialog)
 	ON_COMMAND(ID_COPY, OnMenuCopy)
 	ON_COMMAND(ID_DELETE, OnMenuDelete)
 	ON_COMMAND(ID_EXPORT, OnMenuExport)
+	ON_COMMAND(ID_MOST_CALLED, OnMenuMostCalled)
+	ON_COMMAND(ID_MOST_MISSED, OnMenuMostMissed)
 	ON_NOTIFY(NM_DBLCLK, IDC_CALLS, &Calls::OnNMDblclkCalls)
+	ON_NOTIFY(LVN_ENDSCROLL, IDC_CALLS, &Calls::OnEndScroll)
+	ON_NOTIFY(LVN_GETDISPINFO, IDC_CALLS, &Calls::OnGetDispInfo)
+	ON_NOTIFY(LVN_ODFINDITEM, IDC_CALLS, &Calls::OnFindItem)
 	ON_MESSAGE(WM_CONTEXTMENU, OnContextMenu)
+	ON_MESSAGE(UM_CALLS_EXPORT, OnCallsExport)
 #ifdef _GLOBAL_VIDEO
 	ON_COMMAND(ID_VIDEOCALL, OnMenuCallVideo)
 #endif
@@ -182,6 +202,12 @@ void Calls::OnEndtrack(NMHDR* pNMHDR, LRESULT* pResult)
 	*pResult = 0;
 }
 
+void Calls::OnEndScroll(NMHDR* pNMHDR, LRESULT* pResult)
+{
+	CallsLoadVisible();
+	*pResult = 0;
+}
+
 
 void Calls::OnBnClickedOk()
 {
@@ -225,7 +251,15 @@ void Calls::OnBnClickedCancel()
 void Calls::OnFilterValueChange()
 {
 	CallsClear();
+	StatsViewClear();
+	if (!isFiltered()) {
+		if (history.Trim()) {
+			search.RemoveAll();
+			SearchIndexAppend(0);
+		}
+	}
 	CallsLoad();
+	CallsLoadVisible();
 }
 
 bool Calls::isFiltered(Call* pCall) {
@@ -237,17 +271,19 @@ bool Calls::isFiltered(Call* pCall) {
 			return true;
 		}
 		str.MakeLower();
-		CString name = pCall->name;
-		CString number = pCall->number;
-		name.MakeLower();
-		number.MakeLower();
-		if (name.Find(str) == -1 && number.Find(str) == -1) {
-			return true;
-		}
+		return !CallMatch(pCall, str);
 	}
 	return false;
 }
 
+bool Calls::CallMatch(Call* pCall, CString filter)
+{
+	// filter is expected in lower case, matches what the search index would find
+	CString text = SearchText(pCall);
+	text.MakeLower();
+	return text.Find(filter) != -1;
+}
+
 void Calls::filterReset()
 {
 	CEdit* edit = (CEdit*)GetDlgItem(IDC_FILER_VALUE);
@@ -299,7 +335,7 @@ LRESULT Calls::OnContextMenu(WPARAM wParam, LPARAM lParam)
 			if (!disabled) {
 				POSITION pos = list->GetFirstSelectedItemPosition();
 				int i = list->GetNextSelectedItem(pos);
-				Call* pCall = (Call*)list->GetItemData(i);
+				Call* pCall = GetRow(i);
 				if (mainDlg->pageContacts->FindContact(pCall->number)) {
 					disabled = true;
 				}
@@ -334,8 +370,13 @@ LRESULT Calls::OnContextMenu(WPARAM wParam, LPARAM lParam)
 				tracker->EnableMenuItem(ID_COPY, TRUE);
 				tracker->EnableMenuItem(ID_DELETE, TRUE);
 			}
+			if (statsView != -1) {
+				tracker->EnableMenuItem(ID_DELETE, TRUE);
+			}
 			tracker->AppendMenu(0, MF_SEPARATOR);
 			tracker->AppendMenu(MF_STRING, ID_EXPORT, Translate(_T("Export")));
+			tracker->AppendMenu(MF_STRING | (statsView == MSIP_CALL_STATS_CALLS ? MF_CHECKED : 0), ID_MOST_CALLED, Translate(_T("Most Called")));
+			tracker->AppendMenu(MF_STRING | (statsView == MSIP_CALL_STATS_MISSED ? MF_CHECKED : 0), ID_MOST_MISSED, Translate(_T("Most Missed")));
 #ifdef _GLOBAL_VIDEO
 			if (accountSettings.disableVideo) {
 				tracker->RemoveMenu(ID_VIDEOCALL, MF_BYCOMMAND);
@@ -364,7 +405,7 @@ void Calls::MessageDlgOpen(BOOL isCall, BOOL hasVideo)
 	POSITION pos = list->GetFirstSelectedItemPosition();
 	if (pos) {
 		int i = list->GetNextSelectedItem(pos);
-		Call* pCall = (Call*)list->GetItemData(i);
+		Call* pCall = GetRow(i);
 		if (isCall) {
 			mainDlg->MakeCall(pCall->number, hasVideo, false, pCall->type != MSIP_CALL_OUT);
 		}
@@ -408,7 +449,7 @@ void Calls::OnMenuAdd()
 	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
 	POSITION pos = list->GetFirstSelectedItemPosition();
 	int i = list->GetNextSelectedItem(pos);
-	Call* pCall = (Call*)list->GetItemData(i);
+	Call* pCall = GetRow(i);
 	Contact contact;
 	contact.number = pCall->number;
 	contact.name = pCall->name;
@@ -421,117 +462,100 @@ void Calls::OnMenuCopy()
 	POSITION pos = list->GetFirstSelectedItemPosition();
 	if (pos) {
 		int i = list->GetNextSelectedItem(pos);
-		Call* pCall = (Call*)list->GetItemData(i);
+		Call* pCall = GetRow(i);
 		mainDlg->CopyStringToClipboard(pCall->number);
 	}
 }
 
 void Calls::OnMenuDelete()
 {
+	if (statsView != -1) {
+		return;
+	}
 	CListCtrl* pList = (CListCtrl*)GetDlgItem(IDC_CALLS);
+	CArray<int> selected;
 	POSITION pos = pList->GetFirstSelectedItemPosition();
 	while (pos) {
-		Delete(pList->GetNextSelectedItem(pos));
-		pos = pList->GetFirstSelectedItemPosition();
+		selected.Add(pList->GetNextSelectedItem(pos));
+	}
+	pList->SetItemState(-1, 0, LVIS_SELECTED);
+	for (int i = selected.GetCount() - 1; i >= 0; i--) {
+		Delete(selected.GetAt(i));
 	}
 }
 
 void Calls::OnMenuExport()
 {
-	TCHAR szFilters[] = _T("CSV Files (*.csv)|*.csv|XML Files (*.xml)|*.xml||");
+	TCHAR szFilters[] = _T("CSV Files (*.csv)|*.csv|XML Files (*.xml)|*.xml|JSON Lines Files (*.ndjson)|*.ndjson||");
 	CFileDialog dlgFile(FALSE, _T("csv"), _T("Calls"), OFN_PATHMUSTEXIST | OFN_OVERWRITEPROMPT | OFN_HIDEREADONLY, szFilters, this);
 	if (dlgFile.DoModal() == IDOK) {
-		if (isFiltered()) {
-			filterReset();
-		}
-		CString filename = dlgFile.GetPathName();
+		CallExport* data = new CallExport();
+		data->filename = dlgFile.GetPathName();
 		if (dlgFile.m_ofn.nFilterIndex == 2) {
+			data->format = MSIP_CALL_EXPORT_XML;
 			if (dlgFile.GetFileExt().IsEmpty()) {
-				filename.Append(_T(".xml"));
-			}
-			CMarkup xml;
-			xml.AddElem(_T("calls"));
-			xml.IntoElem();
-			CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-			int count = list->GetItemCount();
-			for (int i = 0; i < count; i++) {
-				Call* pCall = (Call*)list->GetItemData(i);
-				xml.AddElem(_T("call"));
-				xml.AddAttrib(_T("type"), pCall->type == MSIP_CALL_OUT ? _T("out") : (pCall->type == MSIP_CALL_IN ? _T("in") :
-					(pCall->type == MSIP_CALL_MISS ? _T("miss") : _T("else"))
-					));
-				xml.AddAttrib(_T("name"), pCall->name);
-				xml.AddAttrib(_T("number"), pCall->number);
-				CString str;
-				str.Format(_T("%d"), pCall->time);
-				xml.AddAttrib(_T("time"), str);
-				str.Format(_T("%d"), pCall->duration);
-				xml.AddAttrib(_T("duration"), str);
-				xml.AddAttrib(_T("info"), pCall->info);
+				data->filename.Append(_T(".xml"));
 			}
-			CFile file;
-			CFileException fileException;
-			if (file.Open(filename, CFile::modeCreate | CFile::modeWrite, &fileException)) {
-				CStringA str = "<?xml version=\"1.0\"?>\r\n";
-				str.Append(MSIP::Utf8EncodeUni(xml.GetDoc()));
-				file.Write(str.GetBuffer(), str.GetLength());
-				file.Close();
+		}
+		else if (dlgFile.m_ofn.nFilterIndex == 3) {
+			data->format = MSIP_CALL_EXPORT_NDJSON;
+			if (dlgFile.GetFileExt().IsEmpty()) {
+				data->filename.Append(_T(".ndjson"));
 			}
 		}
 		else {
+			data->format = MSIP_CALL_EXPORT_CSV;
 			if (dlgFile.GetFileExt().IsEmpty()) {
-				filename.Append(_T(".csv"));
-			}
-			CCSVFile CSVFile;
-			CSVFile.SetCodePage(CP_UTF8);
-			if (CSVFile.Open(filename, CCSVFile::modeCreate | CCSVFile::modeWrite | CFile::typeText | CFile::shareExclusive)) {
-				CStringArray arr;
-				arr.Add(_T("Type"));
-				arr.Add(_T("Name"));
-				arr.Add(_T("Number"));
-				arr.Add(_T("Time"));
-				arr.Add(_T("Duration"));
-				arr.Add(_T("Info"));
-				CSVFile.WriteData(arr);
-				CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-				int count = list->GetItemCount();
-				for (int i = 0; i < count; i++) {
-					Call* pCall = (Call*)list->GetItemData(i);
-					arr.RemoveAll();
-					arr.Add(pCall->type == MSIP_CALL_OUT ? _T("out") : (pCall->type == MSIP_CALL_IN ? _T("in") :
-						(pCall->type == MSIP_CALL_MISS ? _T("miss") : _T("else"))
-						));
-					arr.Add(pCall->name);
-					arr.Add(pCall->number);
-					CString str;
-					str.Format(_T("%d"), pCall->time);
-					arr.Add(str);
-					str.Format(_T("%d"), pCall->duration);
-					arr.Add(str);
-					arr.Add(pCall->info);
-					CSVFile.WriteData(arr);
-				}
-				CSVFile.Close();
+				data->filename.Append(_T(".csv"));
 			}
 		}
+		// the whole stored history, not just what the list shows
+		data->path = history.GetPath();
+		history.GetMonths(&data->months);
+		data->timeFrom = 0;
+		data->timeTo = 0;
+		data->hWnd = m_hWnd;
+		data->message = UM_CALLS_EXPORT;
+		CallExportAsync(data);
 	}
 }
 
+LRESULT Calls::OnCallsExport(WPARAM wParam, LPARAM lParam)
+{
+	CallExport* data = (CallExport*)lParam;
+	if (!data->result) {
+		AfxMessageBox(Translate(_T("Export failed")));
+	}
+	delete data;
+	return 0;
+}
+
 
 void Calls::Delete(int i)
 {
 	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-	Call* pCall = (Call*)list->GetItemData(i);
-	pCall->number = _T("");
-	CallSave(pCall);
-	delete pCall;
-	list->DeleteItem(i);
+	Call* pCall = GetRow(i);
+	rows.RemoveAt(i);
+	list->SetItemCountEx(rows.GetCount(), LVSICF_NOSCROLL);
+	search.Remove(pCall);
+	stats.Remove(pCall);
+	SuggestUpdate(pCall->number);
+	history.Delete(pCall);
 }
 
 void Calls::DeleteAll()
 {
 	CallsClear();
-	WritePrivateProfileSection(_T("Calls"), NULL, accountSettings.iniFile);
+	StatsViewClear();
+	search.RemoveAll();
+	CArray<CallStatsEntry*> top;
+	stats.GetTop(MSIP_CALL_STATS_CALLS, INT_MAX, &top);
+	for (int i = 0; i < top.GetCount(); i++) {
+		mainDlg->pageDialer->suggest.CallSet(top.GetAt(i)->number, top.GetAt(i)->name, 0, 0);
+	}
+	stats.RemoveAll();
+	history.DeleteAll();
+	StatsSave();
 }
 
 void Calls::Add(pj_str_t id, CString number, CString name, int type, call_user_data *user_data)
@@ -586,122 +610,395 @@ void Calls::Add(pj_str_t id, CString number, CString name, int type, call_user_d
 	}
 
 	CString callId = MSIP::PjToStr(&id);
-	int i = Get(callId);
-	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-	if (i == -1) {
+	Call* pCall = Get(callId);
+	if (!pCall) {
 		ReloadTime();
-			Call* pCall = new Call();
+			pCall = new Call();
 			pCall->id = callId;
 			pCall->number = numberLocal;
 			pCall->name = name;
 			pCall->type = type;
 			pCall->time = CTime::GetCurrentTime().GetTime();
 			pCall->duration = 0;
-			pCall->key = GetNextKey();
+			history.Add(pCall);
+			search.Add(pCall, SearchText(pCall));
+			stats.Add(pCall);
+			SuggestUpdate(pCall->number);
 			Insert(pCall);
-			CallSave(pCall);
-			SaveKey();
 	}
-	else {
-		bool changed = false;
-		Call* pCall = (Call*)list->GetItemData(i);
-		if (pCall->number != numberLocal) {
-			pCall->number = numberLocal;
-			list->SetItemText(i, MSIP_CALLS_COL_NUMBER, pCall->number);
-			changed = true;
-		}
-		if (pCall->name != name) {
-			pCall->name = name;
-			list->SetItemText(i, MSIP_CALLS_COL_NAME, pCall->name);
-			changed = true;
-		}
-		if (pCall->type != type) {
-			pCall->type = type;
-			list->SetItem(i, 0, LVIF_IMAGE, NULL, type, 0, 0, 0);
-			changed = true;
-		}
-		if (changed) {
-			CallSave(pCall);
-		}
+	else if (pCall->number != numberLocal || pCall->name != name || pCall->type != type) {
+		stats.Remove(pCall);
+		CString numberOld = pCall->number;
+		pCall->number = numberLocal;
+		pCall->name = name;
+		pCall->type = type;
+		stats.Add(pCall);
+		SuggestUpdate(numberOld);
+		SuggestUpdate(pCall->number);
+		search.Update(pCall, SearchText(pCall));
+		history.Save(pCall);
+		RedrawVisible();
 	}
 }
 
 void Calls::SetName(pj_str_t id, CString name) {
-	CString callId = MSIP::PjToStr(&id);
-	int i = Get(callId);
-	if (i != -1) {
-		CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-		Call* pCall = (Call*)list->GetItemData(i);
+	Call* pCall = Get(MSIP::PjToStr(&id));
+	if (pCall) {
+		stats.Remove(pCall);
 		pCall->name = name;
-		list->SetItemText(i, MSIP_CALLS_COL_NAME, name);
-		CallSave(pCall);
+		stats.Add(pCall);
+		SuggestUpdate(pCall->number);
+		search.Update(pCall, SearchText(pCall));
+		history.Save(pCall);
+		RedrawVisible();
 	}
 }
 
 void Calls::SetDuration(pj_str_t id, int sec) {
-	CString callId = MSIP::PjToStr(&id);
-	int i = Get(callId);
-	if (i != -1) {
-		CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-		Call* pCall = (Call*)list->GetItemData(i);
+	Call* pCall = Get(MSIP::PjToStr(&id));
+	if (pCall) {
+		stats.Remove(pCall);
 		pCall->duration = sec;
-		list->SetItemText(i, MSIP_CALLS_COL_DURATION, MSIP::GetDuration(pCall->duration));
-		CallSave(pCall);
+		stats.Add(pCall);
+		history.Save(pCall);
+		RedrawVisible();
 	}
 }
 
 void Calls::SetInfo(pj_str_t id, CString str) {
-	CString callId = MSIP::PjToStr(&id);
-	int i = Get(callId);
-	if (i != -1) {
-		CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-		Call* pCall = (Call*)list->GetItemData(i);
+	Call* pCall = Get(MSIP::PjToStr(&id));
+	if (pCall) {
 		pCall->info = str;
-		list->SetItemText(i, MSIP_CALLS_COL_INFO, str);
-		CallSave(pCall);
+		search.Update(pCall, SearchText(pCall));
+		history.Save(pCall);
+		RedrawVisible();
+	}
+}
+
+void Calls::BeginUpdate()
+{
+	history.BeginUpdate();
+}
+
+void Calls::EndUpdate()
+{
+	history.EndUpdate();
+	StatsSave();
+}
+
+static void StatsAdd(Call* pCall, void* param)
+{
+	((CallStats*)param)->Add(pCall);
+}
+
+void Calls::StatsLoad()
+{
+	if (!stats.Load(history.GetPath() + _T("stats.dat"))) {
+		// first run with statistics, count the stored history once
+		stats.RemoveAll();
+		history.ForEach(StatsAdd, &stats);
+		StatsSave();
+	}
+	CArray<CallStatsEntry*> top;
+	stats.GetTop(MSIP_CALL_STATS_CALLS, INT_MAX, &top);
+	DialSuggest* suggest = &mainDlg->pageDialer->suggest;
+	suggest->BeginUpdate();
+	for (int i = 0; i < top.GetCount(); i++) {
+		CallStatsEntry* entry = top.GetAt(i);
+		suggest->CallSet(entry->number, entry->name, entry->calls, entry->lastTime);
+	}
+	suggest->EndUpdate();
+}
+
+void Calls::SuggestUpdate(CString number)
+{
+	CallStatsEntry* entry = stats.Get(number);
+	if (entry) {
+		mainDlg->pageDialer->suggest.CallSet(number, entry->name, entry->calls, entry->lastTime);
+	}
+	else {
+		mainDlg->pageDialer->suggest.CallSet(number, _T(""), 0, 0);
 	}
 }
 
-int Calls::Get(CString id)
+void Calls::StatsSave()
 {
+	if (stats.dirty) {
+		history.FileSave(_T("stats.dat"), stats.Encode());
+	}
+}
+
+void Calls::StatsView(int ranking)
+{
+	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
+	bool active = statsView == ranking;
 	if (isFiltered()) {
+		// statistics are not filtered
 		filterReset();
 	}
+	CallsClear();
+	StatsViewClear();
+	if (active) {
+		CallsLoad();
+		CallsLoadVisible();
+		return;
+	}
+	statsView = ranking;
+	CArray<CallStatsEntry*> top;
+	stats.GetTop(ranking, 100, &top);
+	for (int i = 0; i < top.GetCount(); i++) {
+		CallStatsEntry* entry = top.GetAt(i);
+		Call* pCall = new Call();
+		pCall->key = -1;
+		pCall->number = entry->number;
+		pCall->name = entry->name.IsEmpty() ? entry->number : entry->name;
+		pCall->type = ranking == MSIP_CALL_STATS_MISSED ? MSIP_CALL_MISS : MSIP_CALL_OUT;
+		pCall->time = entry->lastTime;
+		pCall->duration = entry->duration;
+		pCall->info.Format(_T("%d %s, %d %s"), entry->calls, Translate(_T("calls")), entry->missed, Translate(_T("missed")));
+		statsRows.Add(pCall);
+	}
+	// keep the ranking order, header sorting still works on these rows
+	rows.Copy(statsRows);
+	list->SetItemCountEx(rows.GetCount(), LVSICF_NOSCROLL);
+	list->Invalidate();
+}
+
+void Calls::StatsViewClear()
+{
+	statsView = -1;
+	for (int i = 0; i < statsRows.GetCount(); i++) {
+		delete statsRows.GetAt(i);
+	}
+	statsRows.RemoveAll();
+}
+
+void Calls::OnMenuMostCalled()
+{
+	StatsView(MSIP_CALL_STATS_CALLS);
+}
+
+void Calls::OnMenuMostMissed()
+{
+	StatsView(MSIP_CALL_STATS_MISSED);
+}
+
+Call* Calls::Get(CString id)
+{
+	return history.Find(id);
+}
+
+void Calls::RedrawVisible()
+{
+	// rows take their text from the Call records, repaint only what is on screen
 	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
 	int count = list->GetItemCount();
-	for (int i = 0; i < count; i++)
-	{
-		Call* pCall = (Call*)list->GetItemData(i);
-		if (pCall->id == id) {
-			return i;
-		}
+	if (count) {
+		int top = list->GetTopIndex();
+		list->RedrawItems(top, min(top + list->GetCountPerPage(), count - 1));
+	}
+}
+
+void Calls::Insert(Call* pCall)
+{
+	if (statsView != -1 || isFiltered(pCall)) {
+		return;
 	}
-	return -1;
+	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
+	CList<Call*> selected;
+	Call* pCallFocused;
+	SelectionSave(&selected, &pCallFocused);
+	rows.InsertAt(SortedIndex(pCall), pCall);
+	list->SetItemCountEx(rows.GetCount(), LVSICF_NOSCROLL);
+	SelectionRestore(&selected, pCallFocused);
 }
 
+Call* Calls::GetRow(int i)
+{
+	if (i < 0 || i >= rows.GetCount()) {
+		return NULL;
+	}
+	return rows.GetAt(i);
+}
 
-void Calls::Insert(Call* pCall, int pos)
+void Calls::SelectionSave(CList<Call*>* selected, Call** pCallFocused)
 {
-	if (isFiltered(pCall)) {
+	// owner data rows keep their state by index, so it has to follow the records
+	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
+	POSITION pos = list->GetFirstSelectedItemPosition();
+	while (pos) {
+		selected->AddTail(GetRow(list->GetNextSelectedItem(pos)));
+	}
+	*pCallFocused = GetRow(list->GetNextItem(-1, LVNI_FOCUSED));
+}
+
+void Calls::SelectionRestore(CList<Call*>* selected, Call* pCallFocused)
+{
+	if (selected->IsEmpty() && !pCallFocused) {
 		return;
 	}
 	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-	int i = list->InsertItem(LVIF_TEXT | LVIF_PARAM | LVIF_IMAGE, pos, pCall->name, 0, 0, pCall->type, (LPARAM)pCall);
-	list->SetItemText(i, MSIP_CALLS_COL_NUMBER, pCall->number);
-	list->SetItemText(i, MSIP_CALLS_COL_TIME, FormatTime(pCall->time));
-	list->SetItemText(i, MSIP_CALLS_COL_DURATION, MSIP::GetDuration(pCall->duration));
-	list->SetItemText(i, MSIP_CALLS_COL_INFO, pCall->info);
+	list->SetItemState(-1, 0, LVIS_SELECTED | LVIS_FOCUSED);
+	CMap<Call*, Call*, int, int> lookup;
+	POSITION pos = selected->GetHeadPosition();
+	while (pos) {
+		lookup.SetAt(selected->GetNext(pos), 0);
+	}
+	int found = 0;
+	int count = rows.GetCount();
+	for (int i = 0; i < count && (found < lookup.GetCount() || pCallFocused); i++) {
+		Call* pCall = rows.GetAt(i);
+		int value;
+		if (lookup.Lookup(pCall, value)) {
+			list->SetItemState(i, LVIS_SELECTED, LVIS_SELECTED);
+			found++;
+		}
+		if (pCall == pCallFocused) {
+			list->SetItemState(i, LVIS_FOCUSED, LVIS_FOCUSED);
+			pCallFocused = NULL;
+		}
+	}
+}
+
+struct CallsSortParam {
+	int column;
+	bool ascending;
+};
+
+static int __cdecl CallsSortCompare(void* context, const void* a, const void* b)
+{
+	CallsSortParam* param = (CallsSortParam*)context;
+	Call* pCall1 = *(Call**)a;
+	Call* pCall2 = *(Call**)b;
+	int ret;
+	switch (param->column) {
+	case MSIP_CALLS_COL_NUMBER:
+		ret = pCall1->number.Compare(pCall2->number);
+		break;
+	case MSIP_CALLS_COL_TIME:
+		ret = pCall1->time > pCall2->time ? 1 : (pCall1->time < pCall2->time ? -1 : 0);
+		break;
+	case MSIP_CALLS_COL_DURATION:
+		ret = pCall1->duration > pCall2->duration ? 1 : (pCall1->duration < pCall2->duration ? -1 : 0);
+		break;
+	case MSIP_CALLS_COL_INFO:
+		ret = pCall1->info.Compare(pCall2->info);
+		break;
+	default:
+		ret = pCall1->name.Compare(pCall2->name);
+	}
+	if (!param->ascending) {
+		ret = -ret;
+	}
+	if (ret == 0 && param->column > 0 && param->column != MSIP_CALLS_COL_TIME) {
+		ret = pCall1->name.Compare(pCall2->name);
+	}
+	return ret;
+}
+
+void Calls::SortRows(int column, bool ascending)
+{
+	if (column < 0 || rows.GetCount() < 2) {
+		// history order, newest first
+		return;
+	}
+	CList<Call*> selected;
+	Call* pCallFocused;
+	SelectionSave(&selected, &pCallFocused);
+	CallsSortParam param;
+	param.column = column;
+	param.ascending = ascending;
+	qsort_s(rows.GetData(), rows.GetCount(), sizeof(Call*), CallsSortCompare, &param);
+	SelectionRestore(&selected, pCallFocused);
+	GetDlgItem(IDC_CALLS)->Invalidate();
+}
+
+// position of a new row in the current sort order
+int Calls::SortedIndex(Call* pCall)
+{
+	int column = m_SortItemsExListCtrl.GetSortColumn();
+	if (column < 0) {
+		return 0;
+	}
+	CallsSortParam param;
+	param.column = column;
+	param.ascending = m_SortItemsExListCtrl.IsAscending();
+	int low = 0;
+	int high = rows.GetCount();
+	while (low < high) {
+		int mid = (low + high) / 2;
+		if (CallsSortCompare(&param, &rows.GetData()[mid], &pCall) < 0) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+void Calls::OnGetDispInfo(NMHDR* pNMHDR, LRESULT* pResult)
+{
+	NMLVDISPINFO* pDispInfo = reinterpret_cast<NMLVDISPINFO*>(pNMHDR);
+	LVITEM* pItem = &pDispInfo->item;
+	Call* pCall = GetRow(pItem->iItem);
+	if (pCall) {
+		if (pItem->mask & LVIF_TEXT) {
+			CString str;
+			switch (pItem->iSubItem) {
+			case MSIP_CALLS_COL_NAME:
+				str = pCall->name;
+				break;
+			case MSIP_CALLS_COL_NUMBER:
+				str = pCall->number;
+				break;
+			case MSIP_CALLS_COL_TIME:
+				str = GetTimeText(pCall->time);
+				break;
+			case MSIP_CALLS_COL_DURATION:
+				str = MSIP::GetDuration(pCall->duration);
+				break;
+			case MSIP_CALLS_COL_INFO:
+				str = pCall->info;
+				break;
+			}
+			lstrcpyn(pItem->pszText, str, pItem->cchTextMax);
+		}
+		if (pItem->mask & LVIF_IMAGE) {
+			pItem->iImage = pCall->type;
+		}
+	}
+	*pResult = 0;
+}
+
+void Calls::OnFindItem(NMHDR* pNMHDR, LRESULT* pResult)
+{
+	// type-ahead in the list, matches names by prefix
+	NMLVFINDITEM* pFindInfo = reinterpret_cast<NMLVFINDITEM*>(pNMHDR);
+	*pResult = -1;
+	if (!(pFindInfo->lvfi.flags & LVFI_STRING) || !pFindInfo->lvfi.psz) {
+		return;
+	}
+	int len = _tcslen(pFindInfo->lvfi.psz);
+	int count = rows.GetCount();
+	int start = pFindInfo->iStart >= 0 && pFindInfo->iStart < count ? pFindInfo->iStart : 0;
+	for (int j = 0; j < count; j++) {
+		int i = (start + j) % count;
+		if (!(pFindInfo->lvfi.flags & LVFI_WRAP) && i < start) {
+			break;
+		}
+		if (_tcsnicmp(rows.GetAt(i)->name, pFindInfo->lvfi.psz, len) == 0) {
+			*pResult = i;
+			return;
+		}
+	}
 }
 
 void Calls::CallsClear()
 {
 	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-	int count = list->GetItemCount();
-	for (int i = 0; i < count; i++) {
-		Call* pCall = (Call*)list->GetItemData(i);
-		delete pCall;
-	}
-	list->DeleteAllItems();
+	rows.RemoveAll();
+	list->SetItemCount(0);
 }
 
 CString Calls::FormatTime(int time, CTime* pTimeNow)
@@ -723,182 +1020,133 @@ CString Calls::FormatTime(int time, CTime* pTimeNow)
 	);
 }
 
+CString Calls::GetTimeText(int time)
+{
+	// formatted times are valid until the day changes, see ReloadTime
+	CString str;
+	if (!timeTexts.Lookup(time, str)) {
+		if (timeTexts.GetCount() >= 4096) {
+			timeTexts.RemoveAll();
+		}
+		str = FormatTime(time);
+		timeTexts.SetAt(time, str);
+	}
+	return str;
+}
+
 void Calls::ReloadTime()
 {
 	CTime timeNow = CTime::GetCurrentTime();
 	if (lastDay && lastDay != timeNow.GetDay()) {
 		lastDay = timeNow.GetDay();
-		CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
-		int count = list->GetItemCount();
-		for (int i = 0; i < count; i++) {
-			Call* pCall = (Call*)list->GetItemData(i);
-			CTime timeCall(pCall->time);
-			list->SetItemText(i, MSIP_CALLS_COL_TIME, FormatTime(pCall->time, &timeNow));
-		}
+		timeTexts.RemoveAll();
+		GetDlgItem(IDC_CALLS)->Invalidate();
 	}
 }
 
 
-void Calls::CallSave(Call* pCall)
+void Calls::CallsLoad()
 {
-	CString key;
-	// pCall->number == "" means delete
-	CString data = !pCall->number.IsEmpty() ? CallEncode(pCall) : _T("null");
-	key.Format(_T("%d"), pCall->key);
-	WritePrivateProfileString(_T("Calls"), key, data, accountSettings.iniFile);
+	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
+	CallsAppend(0);
+	list->SetItemCountEx(rows.GetCount(), LVSICF_NOSCROLL);
+	m_SortItemsExListCtrl.SortColumn(m_SortItemsExListCtrl.GetSortColumn(), m_SortItemsExListCtrl.IsAscending());
 }
 
-void Calls::CallsLoad()
+void Calls::CallsAppend(int start)
 {
-	CString key;
-	CString val;
-	LPTSTR ptr = val.GetBuffer(255);
-	int prevTime = 0;
-	int pos = -1;
-	int inserted = 0;
-	lastKey = -1;
-	int maxTime = 0;
-	int currTime = CTime::GetCurrentTime().GetTime();
-	int i = 0;
-	int callsLastKey = GetNextKey(true);
-	while (true) {
-		key.Format(_T("%d"), i);
-		if (GetPrivateProfileString(_T("Calls"), key, NULL, ptr, 256, accountSettings.iniFile)) {
-			if (val != _T("null")) {
-				Call* pCall = new Call();
-				CallDecode(ptr, pCall);
-				if (pCall->time > maxTime) {
-					maxTime = pCall->time;
-					lastKey = i;
-				}
-				bool skip = false;
-				if (isFiltered(pCall)) {
-					skip = true;
-					delete pCall;
-				}
-				if (!skip) {
-					pCall->key = i;
-					if (pos == -1) {
-						if (prevTime > pCall->time) {
-							pos = inserted;
-						}
-					}
-					if (pos == -1) {
-						Insert(pCall);
-						prevTime = pCall->time;
-					}
-					else {
-						Insert(pCall, pos);
-					}
-					inserted++;
-				}
+	if (statsView != -1) {
+		// the ranking rows stay on their own
+		return;
+	}
+	CString filter;
+	GetDlgItem(IDC_FILER_VALUE)->GetWindowText(filter);
+	filter.MakeLower();
+	int count = history.calls.GetCount();
+	if (!filter.IsEmpty() && count - start > 64) {
+		CArray<void*> results;
+		search.Search(filter, &results);
+		if (!start) {
+			rows.SetSize(0, results.GetCount());
+			for (int i = 0; i < results.GetCount(); i++) {
+				rows.Add((Call*)results.GetAt(i));
 			}
+			return;
 		}
-		else {
-			if (callsLastKey <= i) {
-				break;
+		// only the records appended from start on are new to rows
+		CMap<void*, void*, int, int> found;
+		found.InitHashTable(results.GetCount() * 2 + 1);
+		for (int i = 0; i < results.GetCount(); i++) {
+			found.SetAt(results.GetAt(i), 0);
+		}
+		for (int i = start; i < count; i++) {
+			Call* pCall = history.calls.GetAt(i);
+			int value;
+			if (found.Lookup(pCall, value)) {
+				rows.Add(pCall);
 			}
 		}
-		i++;
+		return;
+	}
+	for (int i = start; i < count; i++) {
+		Call* pCall = history.calls.GetAt(i);
+		if (filter.IsEmpty() || CallMatch(pCall, filter)) {
+			rows.Add(pCall);
+		}
 	}
-	m_SortItemsExListCtrl.SortColumn(m_SortItemsExListCtrl.GetSortColumn(), m_SortItemsExListCtrl.IsAscending());
 }
 
-CString Calls::CallEncode(Call* pCall)
-{
-	CString data;
-	data.Format(_T("%s;%s;%d;%d;%d;%s"), pCall->number, pCall->name, pCall->type, pCall->time, pCall->duration, pCall->info);
-	return data;
-}
-
-void Calls::CallDecode(CString str, Call* pCall)
-{
-	pCall->number = str;
-	pCall->name = pCall->number;
-	pCall->type = 0;
-	pCall->time = 0;
-	pCall->duration = 0;
-
-	CString rab;
-	int begin;
-	int end;
-	begin = 0;
-	end = str.Find(';', begin);
-
-	if (end != -1)
-	{
-		pCall->number = str.Mid(begin, end - begin);
-		begin = end + 1;
-		end = str.Find(';', begin);
-		if (end != -1)
-		{
-			pCall->name = str.Mid(begin, end - begin);
-			begin = end + 1;
-			end = str.Find(';', begin);
-			if (end != -1)
-			{
-				pCall->type = atoi(CStringA(str.Mid(begin, end - begin)));
-				if (pCall->type > 3 || pCall->type < 0) {
-					pCall->type = 0;
-				}
-				begin = end + 1;
-				end = str.Find(';', begin);
-				if (end != -1)
-				{
-					pCall->time = atoi(CStringA(str.Mid(begin, end - begin)));
-					begin = end + 1;
-					end = str.Find(';', begin);
-					if (end != -1)
-					{
-						pCall->duration = atoi(CStringA(str.Mid(begin, end - begin)));
-						begin = end + 1;
-						end = str.Find(';', begin);
-						if (end != -1)
-						{
-							pCall->info = str.Mid(begin, end - begin);
-							begin = end + 1;
-							end = str.Find(';', begin);
-						}
-						else {
-							pCall->info = str.Mid(begin);
-						}
-					}
-				}
-			}
+CString Calls::SearchText(Call* pCall)
+{
+	// number also without punctuation, so digits typed in a row find it
+	CString digits;
+	for (int i = 0; i < pCall->number.GetLength(); i++) {
+		TCHAR c = pCall->number.GetAt(i);
+		if (c >= '0' && c <= '9') {
+			digits.AppendChar(c);
 		}
 	}
+	CString text;
+	text.Format(_T("%s\n%s\n%s\n%s"), pCall->name, pCall->number, digits, pCall->info);
+	return text;
 }
 
-int Calls::GetNextKey(bool noInc)
+void Calls::SearchIndexAppend(int start)
 {
-	CString str;
-	LPTSTR ptr;
-	CString section;
-	section = _T("Settings");
+	int count = history.calls.GetCount();
+	for (int i = start; i < count; i++) {
+		Call* pCall = history.calls.GetAt(i);
+		search.Add(pCall, SearchText(pCall));
+	}
+}
 
-	ptr = str.GetBuffer(255);
-	GetPrivateProfileString(section, _T("callsLastKey"), _T("-1"), ptr, 256, accountSettings.iniFile);
-	str.ReleaseBuffer();
-	int key = _wtoi(str);
-	if (key != -1) {
-		lastKey = key;
+bool Calls::CallsLoadMore()
+{
+	if (statsView != -1) {
+		return false;
 	}
-	if (!noInc) {
-		lastKey++;
-		if (lastKey >= 1000) {
-			lastKey = 0;
-		}
+	int start = history.calls.GetCount();
+	if (history.LoadNext() < 0) {
+		return false;
 	}
-	return lastKey;
+	SearchIndexAppend(start);
+	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
+	CallsAppend(start);
+	list->SetItemCountEx(rows.GetCount(), LVSICF_NOSCROLL | LVSICF_NOINVALIDATEALL);
+	m_SortItemsExListCtrl.SortColumn(m_SortItemsExListCtrl.GetSortColumn(), m_SortItemsExListCtrl.IsAscending());
+	return true;
 }
 
-void Calls::SaveKey()
+void Calls::CallsLoadVisible()
 {
-	CString str;
-	LPTSTR ptr;
-	CString section;
-	section = _T("Settings");
-
-	str.Format(_T("%d"), lastKey);
-	WritePrivateProfileString(section, _T("callsLastKey"), str, accountSettings.iniFile);
+	// page older months in until the visible part of the list is filled
+	if (statsView != -1) {
+		return;
+	}
+	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CALLS);
+	while (list->GetTopIndex() + list->GetCountPerPage() >= list->GetItemCount()) {
+		if (!CallsLoadMore()) {
+			break;
+		}
+	}
 }
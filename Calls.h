@@ -24,6 +24,10 @@
 #include "CListCtrl_SortItemsEx.h"
 #include "CSVFile.h"
 #include "Markup.h"
+#include "CallHistory.h"
+#include "SearchIndex.h"
+#include "CallStats.h"
+#include "CallExport.h"
 
 class Calls :
 	public CBaseDialog
@@ -38,36 +42,59 @@ public:
 
 	CListCtrl_SortItemsEx m_SortItemsExListCtrl;
 
-	int Get(CString id);
+	Call* Get(CString id);
 	void Add(pj_str_t id, CString number, CString name, int type, call_user_data *user_data);
 	void SetName(pj_str_t id, CString name);
 	void SetDuration(pj_str_t id, int sec);
 	void SetInfo(pj_str_t id, CString str);
+	void BeginUpdate();
+	void EndUpdate();
 	void Delete(int i);
 	void DeleteAll();
 	void UpdateCallButton();
 
 	void CallsLoad();
+	void CallsAppend(int start);
+	void SearchIndexAppend(int start);
+	void StatsLoad();
+	void StatsSave();
+	void SuggestUpdate(CString number);
+	void StatsView(int ranking);
+	void StatsViewClear();
+	bool CallsLoadMore();
+	void CallsLoadVisible();
 	void CallsClear();
 	CString FormatTime(int time, CTime *pTimeNow = NULL);
 	void ReloadTime();
 	bool isFiltered(Call *pCall = NULL);
+	static bool CallMatch(Call *pCall, CString filter);
+	static CString SearchText(Call *pCall);
 	void filterReset();
+	Call* GetRow(int i);
+	void SortRows(int column, bool ascending);
 
 	void OnCreated();
 
 private:
 	CImageList* imageList;
+	CallHistory history;
+	SearchIndex search;
+	CallStats stats;
+	// ranking shown instead of the log, -1 for the log itself
+	int statsView;
+	CArray<Call*> statsRows;
+	// rows of the owner data list: filtered and sorted view of history.calls
+	CArray<Call*> rows;
+	CMap<int, int, CString, LPCTSTR> timeTexts;
 	int lastDay;
-	int lastKey;
-	void CallSave(Call *pCall);
-	void CallDecode(CString str, Call *pCall);
-	CString CallEncode(Call *pCall);
-	void Insert(Call *pCall, int pos = 0);
+	void Insert(Call *pCall);
+	int SortedIndex(Call* pCall);
+	CString GetTimeText(int time);
+	void SelectionSave(CList<Call*>* selected, Call** pCallFocused);
+	void SelectionRestore(CList<Call*>* selected, Call* pCallFocused);
+	void RedrawVisible();
 	void MessageDlgOpen(BOOL isCall = FALSE, BOOL hasVideo = FALSE);
 	void DefaultItemAction(int i);
-	int GetNextKey(bool noInc = false);
-	void SaveKey();
 
 protected:
 	virtual BOOL OnInitDialog();
@@ -85,9 +112,15 @@ public:
 	afx_msg void OnMenuCopy();
 	afx_msg void OnMenuDelete(); 
 	afx_msg void OnMenuExport();
+	afx_msg void OnMenuMostCalled();
+	afx_msg void OnMenuMostMissed();
 	afx_msg LRESULT OnContextMenu(WPARAM wParam,LPARAM lParam);
+	afx_msg LRESULT OnCallsExport(WPARAM wParam, LPARAM lParam);
 	afx_msg void OnNMDblclkCalls(NMHDR *pNMHDR, LRESULT *pResult);
 	afx_msg void OnEndtrack(NMHDR* pNMHDR, LRESULT* pResult);
+	afx_msg void OnEndScroll(NMHDR* pNMHDR, LRESULT* pResult);
+	afx_msg void OnGetDispInfo(NMHDR* pNMHDR, LRESULT* pResult);
+	afx_msg void OnFindItem(NMHDR* pNMHDR, LRESULT* pResult);
 #ifdef _GLOBAL_VIDEO
 	afx_msg void OnMenuCallVideo(); 
 #endif
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "ContactIndex.h"
+
+ContactTrie::ContactTrie()
+{
+	nodes.SetSize(0, 4096);
+	RemoveAll();
+}
+
+ContactTrie::~ContactTrie()
+{
+	Free();
+}
+
+void ContactTrie::Free()
+{
+	for (int i = 0; i < nodes.GetCount(); i++) {
+		delete nodes[i].contacts;
+	}
+	nodes.RemoveAll();
+}
+
+void ContactTrie::RemoveAll()
+{
+	Free();
+	ContactTrieNode root;
+	root.c = 0;
+	root.child = -1;
+	root.next = -1;
+	root.contacts = NULL;
+	nodes.Add(root);
+}
+
+int ContactTrie::Child(int node, TCHAR c, bool create)
+{
+	int prev = -1;
+	int i = nodes[node].child;
+	while (i != -1 && nodes[i].c < c) {
+		prev = i;
+		i = nodes[i].next;
+	}
+	if (i != -1 && nodes[i].c == c) {
+		return i;
+	}
+	if (!create) {
+		return -1;
+	}
+	ContactTrieNode child;
+	child.c = c;
+	child.child = -1;
+	child.next = i;
+	child.contacts = NULL;
+	int k = nodes.Add(child);
+	if (prev == -1) {
+		nodes[node].child = k;
+	}
+	else {
+		nodes[prev].next = k;
+	}
+	return k;
+}
+
+void ContactTrie::Add(CString key, Contact* contact)
+{
+	int node = 0;
+	for (int i = key.GetLength() - 1; i >= 0; i--) {
+		node = Child(node, key.GetAt(i), true);
+	}
+	if (!nodes[node].contacts) {
+		nodes[node].contacts = new CList<Contact*>();
+	}
+	nodes[node].contacts->AddTail(contact);
+}
+
+void ContactTrie::Remove(CString key, Contact* contact)
+{
+	int node = 0;
+	for (int i = key.GetLength() - 1; i >= 0 && node != -1; i--) {
+		node = Child(node, key.GetAt(i));
+	}
+	if (node == -1 || !nodes[node].contacts) {
+		return;
+	}
+	CList<Contact*>* list = nodes[node].contacts;
+	POSITION pos = list->Find(contact);
+	if (pos) {
+		list->RemoveAt(pos);
+	}
+	if (list->IsEmpty()) {
+		delete list;
+		nodes[node].contacts = NULL;
+	}
+}
+
+Contact* ContactTrie::Pick(CList<Contact*>* contacts, int rank)
+{
+	Contact* best = NULL;
+	int bestScore = -1;
+	POSITION pos = contacts->GetHeadPosition();
+	while (pos) {
+		Contact* contact = contacts->GetNext(pos);
+		int score = 0;
+		if ((rank & CONTACT_RANK_STARRED) && contact->starred) {
+			score += 2;
+		}
+		if ((rank & CONTACT_RANK_PERSONAL) && !contact->directory) {
+			score += 1;
+		}
+		if (score > bestScore) {
+			best = contact;
+			bestScore = score;
+		}
+	}
+	return best;
+}
+
+Contact* ContactTrie::Find(CString number, int maxPrefix, int minLength, int rank)
+{
+	Contact* best = NULL;
+	int len = number.GetLength();
+	int node = 0;
+	for (int depth = 1; depth <= len; depth++) {
+		node = Child(node, number.GetAt(len - depth));
+		if (node == -1) {
+			break;
+		}
+		if (nodes[node].contacts) {
+			if (depth == len || (len - depth <= maxPrefix && depth >= minLength)) {
+				best = Pick(nodes[node].contacts, rank);
+			}
+		}
+	}
+	return best;
+}
+
+ContactIndex::ContactIndex()
+{
+	entries.InitHashTable(65521);
+	numbers.InitHashTable(65521);
+	e164.InitHashTable(65521);
+	buddies.InitHashTable(65521);
+	callerPrefix = 3;
+	callerRank = 0;
+}
+
+ContactIndex::~ContactIndex()
+{
+	RemoveAll();
+}
+
+CString ContactIndex::CallerKey(CString number)
+{
+	CString commands;
+	CString numberFormated = FormatNumber(number, &commands);
+	SIPURI sipuri;
+	MSIP::ParseSIPURI(numberFormated, &sipuri);
+	return !sipuri.user.IsEmpty() ? sipuri.user : sipuri.domain;
+}
+
+CString ContactIndex::BuddyKey(CString number)
+{
+	CString commands;
+	return FormatNumber(number, &commands, true);
+}
+
+CString ContactIndex::BuddyUri(CString buddy)
+{
+	pjsua_acc_id acc_id;
+	pj_str_t pj_uri;
+	if (msip_verify_sip_url(buddy) != PJ_SUCCESS || !SelectSIPAccount(buddy, acc_id, &pj_uri)) {
+		return _T("");
+	}
+	CString uri = MSIP::PjToStr(&pj_uri);
+	free(pj_uri.ptr);
+	return uri;
+}
+
+CString ContactIndex::E164Key(CString number)
+{
+	int pos = number.Find(',');
+	if (pos > 0) {
+		number = number.Left(pos);
+	}
+	CString digits;
+	int len = number.GetLength();
+	for (int i = 0; i < len; i++) {
+		TCHAR c = number.GetAt(i);
+		if (c >= '0' && c <= '9') {
+			digits.AppendChar(c);
+		}
+		else if ((c != '+' || i > 0) && !_tcschr(_T(" -.()/"), c)) {
+			return _T("");
+		}
+	}
+	if (!len || number.GetAt(0) != '+') {
+		if (digits.Left(2) != _T("00")) {
+			return _T("");
+		}
+		digits = digits.Mid(2);
+	}
+	if (digits.GetLength() < 7 || digits.GetLength() > 15 || digits.GetAt(0) == '0') {
+		return _T("");
+	}
+	return _T("+") + digits;
+}
+
+void ContactIndex::BucketAdd(CMapStringToPtr& map, CString key, Contact* contact)
+{
+	void* bucket;
+	if (!map.Lookup(key, bucket)) {
+		bucket = new CList<Contact*>();
+		map.SetAt(key, bucket);
+	}
+	((CList<Contact*>*)bucket)->AddTail(contact);
+}
+
+void ContactIndex::BucketRemove(CMapStringToPtr& map, CString key, Contact* contact)
+{
+	void* bucket;
+	if (map.Lookup(key, bucket)) {
+		CList<Contact*>* list = (CList<Contact*>*)bucket;
+		POSITION pos = list->Find(contact);
+		if (pos) {
+			list->RemoveAt(pos);
+		}
+		if (list->IsEmpty()) {
+			map.RemoveKey(key);
+			delete list;
+		}
+	}
+}
+
+CList<Contact*>* ContactIndex::BucketGet(CMapStringToPtr& map, CString key)
+{
+	void* bucket;
+	if (map.Lookup(key, bucket)) {
+		return (CList<Contact*>*)bucket;
+	}
+	return NULL;
+}
+
+void ContactIndex::BucketsFree(CMapStringToPtr& map)
+{
+	POSITION pos = map.GetStartPosition();
+	while (pos) {
+		CString key;
+		void* bucket;
+		map.GetNextAssoc(pos, key, bucket);
+		delete (CList<Contact*>*)bucket;
+	}
+	map.RemoveAll();
+}
+
+void ContactIndex::Add(Contact* contact)
+{
+	Remove(contact);
+	ContactIndexEntry* entry = new ContactIndexEntry();
+	entry->number = contact->number;
+	entry->buddy = BuddyKey(contact->number);
+	entry->uri = BuddyUri(entry->buddy);
+	CString fields[CONTACT_INDEX_FIELDS] = { contact->number, contact->phone, contact->mobile };
+	for (int i = 0; i < CONTACT_INDEX_FIELDS; i++) {
+		if (fields[i].IsEmpty()) {
+			continue;
+		}
+		CString caller = CallerKey(fields[i]);
+		CString canonical = E164Key(fields[i]);
+		// a contact is filed once per distinct key
+		for (int j = 0; j < i; j++) {
+			if (entry->caller[j] == caller) {
+				caller.Empty();
+			}
+			if (entry->e164[j] == canonical) {
+				canonical.Empty();
+			}
+		}
+		entry->caller[i] = caller;
+		entry->e164[i] = canonical;
+		if (!caller.IsEmpty()) {
+			callers.Add(caller, contact);
+		}
+		if (!canonical.IsEmpty()) {
+			BucketAdd(e164, canonical, contact);
+		}
+	}
+	entries.SetAt(contact, entry);
+	BucketAdd(numbers, entry->number, contact);
+	BucketAdd(buddies, entry->buddy, contact);
+	if (contact->starred) {
+		starred.AddTail(contact);
+	}
+}
+
+void ContactIndex::Remove(Contact* contact)
+{
+	ContactIndexEntry* entry;
+	if (entries.Lookup(contact, entry)) {
+		BucketRemove(numbers, entry->number, contact);
+		for (int i = 0; i < CONTACT_INDEX_FIELDS; i++) {
+			if (!entry->caller[i].IsEmpty()) {
+				callers.Remove(entry->caller[i], contact);
+			}
+			if (!entry->e164[i].IsEmpty()) {
+				BucketRemove(e164, entry->e164[i], contact);
+			}
+		}
+		BucketRemove(buddies, entry->buddy, contact);
+		POSITION pos = starred.Find(contact);
+		if (pos) {
+			starred.RemoveAt(pos);
+		}
+		entries.RemoveKey(contact);
+		delete entry;
+	}
+}
+
+void ContactIndex::RemoveAll()
+{
+	POSITION pos = entries.GetStartPosition();
+	while (pos) {
+		Contact* contact;
+		ContactIndexEntry* entry;
+		entries.GetNextAssoc(pos, contact, entry);
+		delete entry;
+	}
+	entries.RemoveAll();
+	BucketsFree(numbers);
+	callers.RemoveAll();
+	BucketsFree(e164);
+	BucketsFree(buddies);
+	starred.RemoveAll();
+}
+
+void ContactIndex::Rebuild(CList<Contact*>* contacts)
+{
+	RemoveAll();
+	POSITION pos = contacts->GetHeadPosition();
+	while (pos) {
+		Add(contacts->GetNext(pos));
+	}
+}
+
+CList<Contact*>* ContactIndex::GetStarred()
+{
+	return &starred;
+}
+
+CList<Contact*>* ContactIndex::GetByNumber(CString number)
+{
+	return BucketGet(numbers, number);
+}
+
+CList<Contact*>* ContactIndex::GetByBuddy(CString number)
+{
+	return BucketGet(buddies, number);
+}
+
+CString ContactIndex::GetBuddyKey(Contact* contact, CString* uri)
+{
+	ContactIndexEntry* entry;
+	if (entries.Lookup(contact, entry) && entry->number == contact->number) {
+		if (uri) {
+			*uri = entry->uri;
+		}
+		return entry->buddy;
+	}
+	CString buddy = BuddyKey(contact->number);
+	if (uri) {
+		*uri = BuddyUri(buddy);
+	}
+	return buddy;
+}
+
+void ContactIndex::SetCallerMatch(int prefix, int rank)
+{
+	callerPrefix = prefix;
+	callerRank = rank;
+}
+
+Contact* ContactIndex::FindCaller(CString number)
+{
+	CString canonical = E164Key(number);
+	if (!canonical.IsEmpty()) {
+		CList<Contact*>* list = BucketGet(e164, canonical);
+		if (list) {
+			return ContactTrie::Pick(list, callerRank);
+		}
+	}
+	return callers.Find(number, callerPrefix, 4, callerRank);
+}
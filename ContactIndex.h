@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "global.h"
+
+#define CONTACT_RANK_STARRED 1
+#define CONTACT_RANK_PERSONAL 2
+
+// number, phone and mobile
+#define CONTACT_INDEX_FIELDS 3
+
+struct ContactTrieNode {
+	TCHAR c;
+	int child;
+	int next;
+	CList<Contact*>* contacts;
+};
+
+// Keys stored last character first, so a walk over a number from its end
+// visits every stored key that is a suffix of it in O(number length).
+class ContactTrie
+{
+public:
+	ContactTrie();
+	~ContactTrie();
+
+	void Add(CString key, Contact* contact);
+	void Remove(CString key, Contact* contact);
+	void RemoveAll();
+	// exact key, or the longest key of at least minLength characters that
+	// the number ends with after at most maxPrefix extra leading characters
+	Contact* Find(CString number, int maxPrefix, int minLength, int rank);
+	static Contact* Pick(CList<Contact*>* contacts, int rank);
+
+private:
+	// node 0 is the root, children are sorted by character
+	CArray<ContactTrieNode> nodes;
+
+	int Child(int node, TCHAR c, bool create = false);
+	void Free();
+};
+
+struct ContactIndexEntry {
+	CString number;
+	CString buddy;
+	// buddy URI presence is subscribed to, empty when no account takes it
+	CString uri;
+	// per field, empty when the field is empty or has no such form
+	CString caller[CONTACT_INDEX_FIELDS];
+	CString e164[CONTACT_INDEX_FIELDS];
+};
+
+// Number lookups over the contact list.
+// Every contact is filed under keys computed once when it is added: the number as
+// stored, the untransformed form presence is subscribed with (and the buddy URI
+// for it) and, for number, phone and mobile, the dialed form caller ids are
+// compared with (FormatNumber, SIP user part) and the E.164 form when the field
+// carries a country code. Contacts sharing
+// a key keep the list order. Keys depend on the dial plan and the accounts, Rebuild()
+// recomputes them after those change; re-add a contact when one of its numbers changes.
+// Caller ids are looked up by E.164 form first. They also match a contact whose
+// number follows a trunk prefix or country code of up to callerPrefix characters,
+// the fewest extra characters win and callerRank (CONTACT_RANK_*) picks among
+// contacts with the same number.
+// Starred contacts are also listed on their own, re-add a contact when its star changes.
+class ContactIndex
+{
+public:
+	ContactIndex();
+	~ContactIndex();
+
+	void Add(Contact* contact);
+	void Remove(Contact* contact);
+	void RemoveAll();
+	void Rebuild(CList<Contact*>* contacts);
+	CList<Contact*>* GetByNumber(CString number);
+	CList<Contact*>* GetByBuddy(CString number);
+	CString GetBuddyKey(Contact* contact, CString* uri = NULL);
+	Contact* FindCaller(CString number);
+	CList<Contact*>* GetStarred();
+	void SetCallerMatch(int prefix, int rank);
+
+	static CString CallerKey(CString number);
+	static CString BuddyKey(CString number);
+	static CString BuddyUri(CString buddy);
+	static CString E164Key(CString number);
+
+private:
+	CMap<Contact*, Contact*, ContactIndexEntry*, ContactIndexEntry*> entries;
+	CMapStringToPtr numbers;
+	ContactTrie callers;
+	CMapStringToPtr e164;
+	CMapStringToPtr buddies;
+	CList<Contact*> starred;
+	int callerPrefix;
+	int callerRank;
+
+	static void BucketAdd(CMapStringToPtr& map, CString key, Contact* contact);
+	static void BucketRemove(CMapStringToPtr& map, CString key, Contact* contact);
+	static CList<Contact*>* BucketGet(CMapStringToPtr& map, CString key);
+	static void BucketsFree(CMapStringToPtr& map);
+};
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "ContactStore.h"
+#include "settings.h"
+
+ContactStore::ContactStore()
+{
+	filename = accountSettings.pathRoaming;
+	filename.Append(_T("Contacts.xml"));
+	pending = NULL;
+	writerThread = NULL;
+	writerEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	writerStop = false;
+}
+
+ContactStore::~ContactStore()
+{
+	if (writerThread) {
+		// the writer drains what is pending before it stops
+		pendingCS.Lock();
+		writerStop = true;
+		pendingCS.Unlock();
+		SetEvent(writerEvent);
+		WaitForSingleObject(writerThread, INFINITE);
+		CloseHandle(writerThread);
+	}
+	CloseHandle(writerEvent);
+	delete pending;
+}
+
+static const struct {
+	const char* name;
+	CString Contact::* member;
+} contactAttribs[] = {
+	{ "name", &Contact::name },
+	{ "number", &Contact::number },
+	{ "firstname", &Contact::firstname },
+	{ "lastname", &Contact::lastname },
+	{ "phone", &Contact::phone },
+	{ "mobile", &Contact::mobile },
+	{ "email", &Contact::email },
+	{ "address", &Contact::address },
+	{ "city", &Contact::city },
+	{ "state", &Contact::state },
+	{ "zip", &Contact::zip },
+	{ "comment", &Contact::comment },
+	{ "id", &Contact::id },
+	{ "info", &Contact::info },
+};
+
+static bool AttribIs(const char* name, int len, const char* attrib)
+{
+	return !strncmp(name, attrib, len) && !attrib[len];
+}
+
+static void AttribDecode(const char* value, int len, CString& out)
+{
+	if (!len) {
+		out.Empty();
+		return;
+	}
+	LPTSTR buf = out.GetBuffer(len);
+	int n = MultiByteToWideChar(CP_UTF8, 0, value, len, buf, len);
+	out.ReleaseBuffer(n);
+	if (memchr(value, '&', len)) {
+		out.Replace(_T("&lt;"), _T("<"));
+		out.Replace(_T("&gt;"), _T(">"));
+		out.Replace(_T("&quot;"), _T("\""));
+		out.Replace(_T("&apos;"), _T("'"));
+		int pos = 0;
+		while ((pos = out.Find(_T("&#"), pos)) != -1) {
+			int semicolon = out.Find(';', pos);
+			if (semicolon == -1) {
+				break;
+			}
+			CString code = out.Mid(pos + 2, semicolon - pos - 2);
+			TCHAR c = code.Left(1) == _T("x") ? (TCHAR)_tcstoul(code.Mid(1), NULL, 16) : (TCHAR)_tcstoul(code, NULL, 10);
+			out = out.Left(pos) + c + out.Mid(semicolon + 1);
+			pos++;
+		}
+		out.Replace(_T("&amp;"), _T("&"));
+	}
+}
+
+void ContactStore::Parse(const char* data, const char* end, ContactStoreProc proc, void* param)
+{
+	const char* p = data;
+	while (p < end) {
+		p = (const char*)memchr(p, '<', end - p);
+		if (!p) {
+			break;
+		}
+		p++;
+		if (end - p < 8 || strncmp(p, "contact", 7) || !(isspace((unsigned char)p[7]) || p[7] == '/' || p[7] == '>')) {
+			continue;
+		}
+		p += 7;
+		Contact contact;
+		while (p < end) {
+			while (p < end && isspace((unsigned char)*p)) {
+				p++;
+			}
+			if (p >= end || *p == '/' || *p == '>') {
+				break;
+			}
+			const char* name = p;
+			while (p < end && *p != '=' && !isspace((unsigned char)*p) && *p != '/' && *p != '>') {
+				p++;
+			}
+			int nameLen = p - name;
+			while (p < end && isspace((unsigned char)*p)) {
+				p++;
+			}
+			if (p >= end || *p != '=') {
+				continue;
+			}
+			p++;
+			while (p < end && isspace((unsigned char)*p)) {
+				p++;
+			}
+			if (p >= end || (*p != '"' && *p != '\'')) {
+				break;
+			}
+			char quote = *p++;
+			const char* value = p;
+			p = (const char*)memchr(p, quote, end - p);
+			if (!p) {
+				p = end;
+				break;
+			}
+			int valueLen = p - value;
+			p++;
+			if (AttribIs(name, nameLen, "presence")) {
+				contact.presence = valueLen == 1 && *value == '1';
+			}
+			else if (AttribIs(name, nameLen, "starred")) {
+				contact.starred = valueLen == 1 && *value == '1';
+			}
+			else if (AttribIs(name, nameLen, "directory")) {
+				contact.directory = valueLen == 1 && *value == '1';
+			}
+			else {
+				for (int i = 0; i < _countof(contactAttribs); i++) {
+					if (AttribIs(name, nameLen, contactAttribs[i].name)) {
+						AttribDecode(value, valueLen, contact.*contactAttribs[i].member);
+						break;
+					}
+				}
+			}
+		}
+		proc(&contact, param);
+	}
+}
+
+bool ContactStore::Load(ContactStoreProc proc, void* param)
+{
+	HANDLE file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	DWORD size = GetFileSize(file, NULL);
+	if (size && size != INVALID_FILE_SIZE) {
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			const char* data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data) {
+				Parse(data, data + size, proc, param);
+				UnmapViewOfFile(data);
+			}
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+	return true;
+}
+
+void ContactStore::Save(CList<Contact*>* contacts, bool directory)
+{
+	CArray<Contact>* snapshot = new CArray<Contact>();
+	snapshot->SetSize(contacts->GetCount());
+	int i = 0;
+	POSITION pos = contacts->GetHeadPosition();
+	while (pos) {
+		Contact* contact = contacts->GetNext(pos);
+		if (directory || !contact->directory) {
+			snapshot->ElementAt(i++) = *contact;
+		}
+	}
+	snapshot->SetSize(i);
+	pendingCS.Lock();
+	delete pending;
+	pending = snapshot;
+	pendingCS.Unlock();
+	if (!writerThread) {
+		writerThread = CreateThread(NULL, 0, WriterThread, this, 0, NULL);
+	}
+	SetEvent(writerEvent);
+}
+
+DWORD WINAPI ContactStore::WriterThread(LPVOID lpParam)
+{
+	ContactStore* store = (ContactStore*)lpParam;
+	do {
+		WaitForSingleObject(store->writerEvent, INFINITE);
+	} while (store->WriterRun());
+	return 0;
+}
+
+bool ContactStore::WriterRun()
+{
+	// returns false once stopped
+	while (true) {
+		pendingCS.Lock();
+		CArray<Contact>* snapshot = pending;
+		pending = NULL;
+		bool stop = writerStop;
+		pendingCS.Unlock();
+		if (!snapshot) {
+			return !stop;
+		}
+		MSIP::FileReplace(filename, Serialize(snapshot));
+		delete snapshot;
+	}
+}
+
+static void AttribAppend(CString& doc, LPCTSTR name, const CString& value)
+{
+	doc.AppendFormat(_T(" %s=\""), name);
+	if (value.FindOneOf(_T("&<>\"'")) == -1) {
+		doc.Append(value);
+	}
+	else {
+		int len = value.GetLength();
+		for (int i = 0; i < len; i++) {
+			TCHAR c = value.GetAt(i);
+			switch (c) {
+			case '&':
+				doc.Append(_T("&amp;"));
+				break;
+			case '<':
+				doc.Append(_T("&lt;"));
+				break;
+			case '>':
+				doc.Append(_T("&gt;"));
+				break;
+			case '"':
+				doc.Append(_T("&quot;"));
+				break;
+			case '\'':
+				doc.Append(_T("&apos;"));
+				break;
+			default:
+				doc.AppendChar(c);
+			}
+		}
+	}
+	doc.AppendChar('"');
+}
+
+CStringA ContactStore::Serialize(CArray<Contact>* contacts)
+{
+	CString doc = _T("<contacts>\r\n");
+	int count = contacts->GetCount();
+	for (int i = 0; i < count; i++) {
+		Contact* pContact = &contacts->ElementAt(i);
+		doc.Append(_T("<contact"));
+		AttribAppend(doc, _T("name"), pContact->name);
+		AttribAppend(doc, _T("number"), pContact->number);
+		AttribAppend(doc, _T("firstname"), pContact->firstname);
+		AttribAppend(doc, _T("lastname"), pContact->lastname);
+		AttribAppend(doc, _T("phone"), pContact->phone);
+		AttribAppend(doc, _T("mobile"), pContact->mobile);
+		AttribAppend(doc, _T("email"), pContact->email);
+		AttribAppend(doc, _T("address"), pContact->address);
+		AttribAppend(doc, _T("city"), pContact->city);
+		AttribAppend(doc, _T("state"), pContact->state);
+		AttribAppend(doc, _T("zip"), pContact->zip);
+		AttribAppend(doc, _T("comment"), pContact->comment);
+		AttribAppend(doc, _T("id"), pContact->id);
+		AttribAppend(doc, _T("info"), pContact->info);
+		AttribAppend(doc, _T("presence"), pContact->presence ? _T("1") : _T("0"));
+		AttribAppend(doc, _T("starred"), pContact->starred ? _T("1") : _T("0"));
+		AttribAppend(doc, _T("directory"), pContact->directory ? _T("1") : _T("0"));
+		doc.Append(_T("/>\r\n"));
+	}
+	doc.Append(_T("</contacts>\r\n"));
+	CStringA str = "<?xml version=\"1.0\"?>\r\n";
+	str.Append(MSIP::Utf8EncodeUni(doc));
+	return str;
+}
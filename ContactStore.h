@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "global.h"
+
+typedef void (*ContactStoreProc)(Contact* contact, void* param);
+
+// Contacts.xml persistence.
+// Load() maps the file and pulls the attributes of each contact element straight
+// from UTF-8 into a Contact, without building a document.
+// Save() copies the contact set (the strings share their buffers with the model)
+// and hands the copy to a writer thread, which serializes it and replaces the file
+// through a temporary one. A copy still waiting for the writer is replaced by a
+// newer one, so a burst of changes costs a single write. Directory contacts are left
+// out when the users directory keeps them itself.
+class ContactStore
+{
+public:
+	ContactStore();
+	~ContactStore();
+
+	bool Load(ContactStoreProc proc, void* param);
+	void Save(CList<Contact*>* contacts, bool directory = true);
+
+	static CStringA Serialize(CArray<Contact>* contacts);
+
+private:
+	CString filename;
+	CArray<Contact>* pending;
+	CCriticalSection pendingCS;
+	HANDLE writerThread;
+	HANDLE writerEvent;
+	bool writerStop;
+
+	static void Parse(const char* data, const char* end, ContactStoreProc proc, void* param);
+	static DWORD WINAPI WriterThread(LPVOID lpParam);
+	bool WriterRun();
+};
@@ -24,7 +24,6 @@
 #include "mainDlg.h"
 #include "langpack.h"
 #include "CSVFile.h"
-#include "Markup.h"
 #include "Transfer.h"
 #include "afxinet.h"
 #include "MessageBoxX.h"
@@ -35,6 +34,7 @@ static bool blinkState = false;
 Contacts::Contacts(CWnd* pParent /*=NULL*/)
 	: CBaseDialog(Contacts::IDD, pParent)
 {
+	savePending = false;
 	Create(IDD, pParent);
 }
 
@@ -71,6 +71,7 @@ BOOL Contacts::OnInitDialog()
 	list->InsertColumn(0, Translate(_T("Name")), LVCFMT_LEFT, accountSettings.contactsWidth0 > 0 ? accountSettings.contactsWidth0 : 160);
 	list->InsertColumn(1, Translate(_T("Number")), LVCFMT_LEFT, accountSettings.contactsWidth1 > 0 ? accountSettings.contactsWidth1 : 100);
 	list->InsertColumn(2, Translate(_T("Info")), LVCFMT_LEFT, accountSettings.contactsWidth2 > 0 ? accountSettings.contactsWidth2 : 120);
+	index.SetCallerMatch(accountSettings.callerIdPrefix, accountSettings.callerIdRank);
 	ContactsLoad();
 
 	return TRUE;
@@ -84,6 +85,9 @@ void Contacts::OnCreated()
 void Contacts::PostNcDestroy()
 {
 	CBaseDialog::PostNcDestroy();
+	if (savePending) {
+		StoreSave();
+	}
 	mainDlg->pageContacts = NULL;
 	delete this;
 }
@@ -123,6 +127,11 @@ void Contacts::OnTimer(UINT_PTR TimerVal)
 	if (TimerVal == IDT_TIMER_CONTACTS_BLINK) {
 		OnTimerContactsBlink();
 	}
+	else if (TimerVal == IDT_TIMER_CONTACTS) {
+		KillTimer(IDT_TIMER_CONTACTS);
+		savePending = false;
+		StoreSave();
+	}
 }
 
 BOOL Contacts::PreTranslateMessage(MSG* pMsg)
@@ -229,17 +238,21 @@ bool Contacts::isFiltered(Contact* contact) {
 			return true;
 		}
 		str.MakeLower();
-		CString name = contact->name;
-		CString number = contact->number;
-		name.MakeLower();
-		number.MakeLower();
-		if (name.Find(str) == -1 && number.Find(str) == -1) {
-			return true;
-		}
+		CString text = SearchText(contact);
+		text.MakeLower();
+		return SearchIndex::Rank(str, text) == SEARCH_RANK_NONE;
 	}
 	return false;
 }
 
+CString Contacts::SearchText(Contact* contact)
+{
+	CString text;
+	text.Format(_T("%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s"), contact->name, contact->number, contact->firstname, contact->lastname,
+		contact->phone, contact->mobile, contact->email, contact->comment, contact->info, contact->city);
+	return text;
+}
+
 void Contacts::filterReset()
 {
 	CEdit* edit = (CEdit*)GetDlgItem(IDC_FILER_VALUE);
@@ -247,17 +260,37 @@ void Contacts::filterReset()
 }
 
 void Contacts::OnFilterValueChange()
+{
+	ListFill();
+	CString str;
+	GetDlgItem(IDC_FILER_VALUE)->GetWindowText(str);
+	mainDlg->UsersDirectorySearch(str);
+}
+
+// lists the contacts the filter matches
+void Contacts::ListFill(bool subscribe)
 {
 	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CONTACTS);
+	CString str;
+	GetDlgItem(IDC_FILER_VALUE)->GetWindowText(str);
+	list->SetRedraw(FALSE);
 	list->DeleteAllItems();
-	POSITION pos = contacts.GetHeadPosition();
-	while (pos) {
-		Contact* contact = contacts.GetNext(pos);
-		if (!isFiltered(contact)) {
-			ListAppend(list, contact);
+	if (str.IsEmpty()) {
+		POSITION pos = contacts.GetHeadPosition();
+		while (pos) {
+			ListAppend(list, contacts.GetNext(pos), subscribe);
 		}
+		m_SortItemsExListCtrl.SortColumn(m_SortItemsExListCtrl.GetSortColumn(), m_SortItemsExListCtrl.IsAscending());
 	}
-	m_SortItemsExListCtrl.SortColumn(m_SortItemsExListCtrl.GetSortColumn(), m_SortItemsExListCtrl.IsAscending());
+	else {
+		// best match on top, rows are inserted at the top
+		CArray<void*> results;
+		search.SearchRanked(str, &results);
+		for (int i = results.GetCount() - 1; i >= 0; i--) {
+			ListAppend(list, (Contact*)results.GetAt(i), subscribe);
+		}
+	}
+	list->SetRedraw(TRUE);
 }
 
 LRESULT Contacts::OnContextMenu(WPARAM wParam, LPARAM lParam)
@@ -508,174 +541,183 @@ void Contacts::OnMenuDelete()
 
 bool Contacts::Import(CString filename, CArray<ContactWithFields*>& contactsWithFields, bool directory)
 {
-	CCSVFile CSVFile;
-	CSVFile.SetCodePage(CP_UTF8);
-	if (CSVFile.Open(filename, CCSVFile::modeRead | CFile::typeText | CFile::shareDenyWrite)) {
-		CStringArray arr;
-		int nameIndex = -1;
-		int numberIndex = -1;
-		int firstnameIndex = -1;
-		int lastnameIndex = -1;
-		int phoneIndex = -1;
-		int mobileIndex = -1;
-		int emailIndex = -1;
-		int addressIndex = -1;
-		int cityIndex = -1;
-		int stateIndex = -1;
-		int zipIndex = -1;
-		int commentIndex = -1;
-		int idIndex = -1;
-		int infoIndex = -1;
-		int presenceIndex = -1;
-		int directoryIndex = -1;
-		int starredIndex = -1;
-		bool header = true;
-		ContactWithFields* contactWithFields;
-		while (CSVFile.ReadData(arr)) {
-			if (header) {
-				for (int i = 0; i < arr.GetCount(); i++) {
-					CString s = arr.GetAt(i);
-					if (nameIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Name")) == 0) {
-						nameIndex = i;
-					}
-					if (numberIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Number")) == 0 || arr.GetAt(i).CompareNoCase(_T("Primary Phone")) == 0 || arr.GetAt(i).CompareNoCase(_T("phone")) == 0)) {
-						numberIndex = i;
-					}
-					if (firstnameIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("First Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("Given Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("first_name")) == 0)) {
-						firstnameIndex = i;
-					}
-					if (lastnameIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Last Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("Family Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("last_name")) == 0)) {
-						lastnameIndex = i;
-					}
-					if (phoneIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Phone Number")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home Phone")) == 0 || arr.GetAt(i).CompareNoCase(_T("Phone 2 - Value")) == 0 || arr.GetAt(i).CompareNoCase(_T("home_number")) == 0)) {
-						phoneIndex = i;
-					}
-					if (mobileIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Mobile Number")) == 0 || arr.GetAt(i).CompareNoCase(_T("Mobile Phone")) == 0 || arr.GetAt(i).CompareNoCase(_T("Phone 1 - Value")) == 0 || arr.GetAt(i).CompareNoCase(_T("mobile_number")) == 0)) {
-						mobileIndex = i;
-					}
-					if (emailIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("E-mail Address")) == 0 || arr.GetAt(i).CompareNoCase(_T("E-mail 1 - Value")) == 0 || arr.GetAt(i).CompareNoCase(_T("email")) == 0)) {
-						emailIndex = i;
-					}
-					if (addressIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Address")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home Address")) == 0)) {
-						addressIndex = i;
-					}
-					if (cityIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("City")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home City")) == 0)) {
-						cityIndex = i;
-					}
-					if (stateIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("State")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home State")) == 0)) {
-						stateIndex = i;
-					}
-					if (zipIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Postal Code")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home Postal Code")) == 0)) {
-						zipIndex = i;
-					}
-					if (commentIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Comment")) == 0 || arr.GetAt(i).CompareNoCase(_T("Notes")) == 0)) {
-						commentIndex = i;
-					}
-					if (idIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Id")) == 0) {
-						idIndex = i;
-					}
-					if (infoIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Info")) == 0) {
-						infoIndex = i;
-					}
-					if (presenceIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Presence")) == 0) {
-						presenceIndex = i;
-					}
-					if (directoryIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Directory")) == 0) {
-						directoryIndex = i;
-					}
-					if (starredIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Starred")) == 0) {
-						starredIndex = i;
-					}
-				}
-				if (numberIndex == -1 && phoneIndex == -1 && mobileIndex == -1) {
-					AfxMessageBox(Translate(_T("The received data cannot be recognized")));
-					break;
-				}
-				header = false;
-			}
-			else {
-				contactWithFields = new ContactWithFields();
-				contactWithFields->contact.directory = directory;
-				if (nameIndex != -1 && arr.GetCount() > nameIndex) {
-					contactWithFields->fields.AddTail(_T("name"));
-					contactWithFields->contact.name = arr.GetAt(nameIndex);
-				}
-				if (numberIndex != -1 && arr.GetCount() > numberIndex) {
-					contactWithFields->fields.AddTail(_T("number"));
-					contactWithFields->contact.number = arr.GetAt(numberIndex);
-				}
-				if (firstnameIndex != -1 && arr.GetCount() > firstnameIndex) {
-					contactWithFields->fields.AddTail(_T("firstname"));
-					contactWithFields->contact.firstname = arr.GetAt(firstnameIndex);
+	CCSVReader reader;
+	if (!reader.Open(filename)) {
+		return false;
+	}
+	return Import(reader, contactsWithFields, directory);
+}
+
+bool Contacts::Import(const char* data, int len, CArray<ContactWithFields*>& contactsWithFields, bool directory)
+{
+	CCSVReader reader;
+	reader.Open(data, len);
+	return Import(reader, contactsWithFields, directory);
+}
+
+bool Contacts::Import(CCSVReader& reader, CArray<ContactWithFields*>& contactsWithFields, bool directory)
+{
+	CStringArray arr;
+	int nameIndex = -1;
+	int numberIndex = -1;
+	int firstnameIndex = -1;
+	int lastnameIndex = -1;
+	int phoneIndex = -1;
+	int mobileIndex = -1;
+	int emailIndex = -1;
+	int addressIndex = -1;
+	int cityIndex = -1;
+	int stateIndex = -1;
+	int zipIndex = -1;
+	int commentIndex = -1;
+	int idIndex = -1;
+	int infoIndex = -1;
+	int presenceIndex = -1;
+	int directoryIndex = -1;
+	int starredIndex = -1;
+	bool header = true;
+	ContactWithFields* contactWithFields;
+	while (reader.ReadData(arr)) {
+		if (header) {
+			for (int i = 0; i < arr.GetCount(); i++) {
+				CString s = arr.GetAt(i);
+				if (nameIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Name")) == 0) {
+					nameIndex = i;
 				}
-				if (lastnameIndex != -1 && arr.GetCount() > lastnameIndex) {
-					contactWithFields->fields.AddTail(_T("lastname"));
-					contactWithFields->contact.lastname = arr.GetAt(lastnameIndex);
+				if (numberIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Number")) == 0 || arr.GetAt(i).CompareNoCase(_T("Primary Phone")) == 0 || arr.GetAt(i).CompareNoCase(_T("phone")) == 0)) {
+					numberIndex = i;
 				}
-				if (phoneIndex != -1 && arr.GetCount() > phoneIndex) {
-					contactWithFields->fields.AddTail(_T("phone"));
-					contactWithFields->contact.phone = arr.GetAt(phoneIndex);
+				if (firstnameIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("First Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("Given Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("first_name")) == 0)) {
+					firstnameIndex = i;
 				}
-				if (mobileIndex != -1 && arr.GetCount() > mobileIndex) {
-					contactWithFields->fields.AddTail(_T("mobile"));
-					contactWithFields->contact.mobile = arr.GetAt(mobileIndex);
+				if (lastnameIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Last Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("Family Name")) == 0 || arr.GetAt(i).CompareNoCase(_T("last_name")) == 0)) {
+					lastnameIndex = i;
 				}
-				if (emailIndex != -1 && arr.GetCount() > emailIndex) {
-					contactWithFields->fields.AddTail(_T("email"));
-					contactWithFields->contact.email = arr.GetAt(emailIndex);
+				if (phoneIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Phone Number")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home Phone")) == 0 || arr.GetAt(i).CompareNoCase(_T("Phone 2 - Value")) == 0 || arr.GetAt(i).CompareNoCase(_T("home_number")) == 0)) {
+					phoneIndex = i;
 				}
-				if (addressIndex != -1 && arr.GetCount() > addressIndex) {
-					contactWithFields->fields.AddTail(_T("address"));
-					contactWithFields->contact.address = arr.GetAt(addressIndex);
+				if (mobileIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Mobile Number")) == 0 || arr.GetAt(i).CompareNoCase(_T("Mobile Phone")) == 0 || arr.GetAt(i).CompareNoCase(_T("Phone 1 - Value")) == 0 || arr.GetAt(i).CompareNoCase(_T("mobile_number")) == 0)) {
+					mobileIndex = i;
 				}
-				if (cityIndex != -1 && arr.GetCount() > cityIndex) {
-					contactWithFields->fields.AddTail(_T("city"));
-					contactWithFields->contact.city = arr.GetAt(cityIndex);
+				if (emailIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("E-mail Address")) == 0 || arr.GetAt(i).CompareNoCase(_T("E-mail 1 - Value")) == 0 || arr.GetAt(i).CompareNoCase(_T("email")) == 0)) {
+					emailIndex = i;
 				}
-				if (stateIndex != -1 && arr.GetCount() > stateIndex) {
-					contactWithFields->fields.AddTail(_T("state"));
-					contactWithFields->contact.state = arr.GetAt(stateIndex);
+				if (addressIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Address")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home Address")) == 0)) {
+					addressIndex = i;
 				}
-				if (zipIndex != -1 && arr.GetCount() > zipIndex) {
-					contactWithFields->fields.AddTail(_T("zip"));
-					contactWithFields->contact.zip = arr.GetAt(zipIndex);
+				if (cityIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("City")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home City")) == 0)) {
+					cityIndex = i;
 				}
-				if (commentIndex != -1 && arr.GetCount() > commentIndex) {
-					contactWithFields->fields.AddTail(_T("comment"));
-					contactWithFields->contact.comment = arr.GetAt(commentIndex);
+				if (stateIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("State")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home State")) == 0)) {
+					stateIndex = i;
 				}
-				if (idIndex != -1 && arr.GetCount() > idIndex) {
-					contactWithFields->fields.AddTail(_T("id"));
-					contactWithFields->contact.id = arr.GetAt(idIndex);
+				if (zipIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Postal Code")) == 0 || arr.GetAt(i).CompareNoCase(_T("Home Postal Code")) == 0)) {
+					zipIndex = i;
 				}
-				if (infoIndex != -1 && arr.GetCount() > infoIndex) {
-					contactWithFields->fields.AddTail(_T("info"));
-					contactWithFields->contact.info = arr.GetAt(infoIndex);
+				if (commentIndex == -1 && (arr.GetAt(i).CompareNoCase(_T("Comment")) == 0 || arr.GetAt(i).CompareNoCase(_T("Notes")) == 0)) {
+					commentIndex = i;
 				}
-				if (presenceIndex != -1 && arr.GetCount() > presenceIndex) {
-					contactWithFields->fields.AddTail(_T("presence"));
-					contactWithFields->contact.presence = arr.GetAt(presenceIndex) == _T("1");
+				if (idIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Id")) == 0) {
+					idIndex = i;
 				}
-				if (directoryIndex != -1 && arr.GetCount() > directoryIndex) {
-					contactWithFields->fields.AddTail(_T("directory"));
-					contactWithFields->contact.directory = arr.GetAt(directoryIndex) == _T("1");
+				if (infoIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Info")) == 0) {
+					infoIndex = i;
 				}
-				if (starredIndex != -1 && arr.GetCount() > starredIndex) {
-					contactWithFields->fields.AddTail(_T("starred"));
-					contactWithFields->contact.starred = arr.GetAt(starredIndex) == _T("1");
+				if (presenceIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Presence")) == 0) {
+					presenceIndex = i;
 				}
-				if (ContactPrepare(&contactWithFields->contact)) {
-					contactsWithFields.Add(contactWithFields);
+				if (directoryIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Directory")) == 0) {
+					directoryIndex = i;
 				}
-				else {
-					delete contactWithFields;
+				if (starredIndex == -1 && arr.GetAt(i).CompareNoCase(_T("Starred")) == 0) {
+					starredIndex = i;
 				}
 			}
+			if (numberIndex == -1 && phoneIndex == -1 && mobileIndex == -1) {
+				return false;
+			}
+			header = false;
+		}
+		else {
+			contactWithFields = new ContactWithFields();
+			contactWithFields->contact.directory = directory;
+			if (nameIndex != -1 && arr.GetCount() > nameIndex) {
+				contactWithFields->fields.AddTail(_T("name"));
+				contactWithFields->contact.name = arr.GetAt(nameIndex);
+			}
+			if (numberIndex != -1 && arr.GetCount() > numberIndex) {
+				contactWithFields->fields.AddTail(_T("number"));
+				contactWithFields->contact.number = arr.GetAt(numberIndex);
+			}
+			if (firstnameIndex != -1 && arr.GetCount() > firstnameIndex) {
+				contactWithFields->fields.AddTail(_T("firstname"));
+				contactWithFields->contact.firstname = arr.GetAt(firstnameIndex);
+			}
+			if (lastnameIndex != -1 && arr.GetCount() > lastnameIndex) {
+				contactWithFields->fields.AddTail(_T("lastname"));
+				contactWithFields->contact.lastname = arr.GetAt(lastnameIndex);
+			}
+			if (phoneIndex != -1 && arr.GetCount() > phoneIndex) {
+				contactWithFields->fields.AddTail(_T("phone"));
+				contactWithFields->contact.phone = arr.GetAt(phoneIndex);
+			}
+			if (mobileIndex != -1 && arr.GetCount() > mobileIndex) {
+				contactWithFields->fields.AddTail(_T("mobile"));
+				contactWithFields->contact.mobile = arr.GetAt(mobileIndex);
+			}
+			if (emailIndex != -1 && arr.GetCount() > emailIndex) {
+				contactWithFields->fields.AddTail(_T("email"));
+				contactWithFields->contact.email = arr.GetAt(emailIndex);
+			}
+			if (addressIndex != -1 && arr.GetCount() > addressIndex) {
+				contactWithFields->fields.AddTail(_T("address"));
+				contactWithFields->contact.address = arr.GetAt(addressIndex);
+			}
+			if (cityIndex != -1 && arr.GetCount() > cityIndex) {
+				contactWithFields->fields.AddTail(_T("city"));
+				contactWithFields->contact.city = arr.GetAt(cityIndex);
+			}
+			if (stateIndex != -1 && arr.GetCount() > stateIndex) {
+				contactWithFields->fields.AddTail(_T("state"));
+				contactWithFields->contact.state = arr.GetAt(stateIndex);
+			}
+			if (zipIndex != -1 && arr.GetCount() > zipIndex) {
+				contactWithFields->fields.AddTail(_T("zip"));
+				contactWithFields->contact.zip = arr.GetAt(zipIndex);
+			}
+			if (commentIndex != -1 && arr.GetCount() > commentIndex) {
+				contactWithFields->fields.AddTail(_T("comment"));
+				contactWithFields->contact.comment = arr.GetAt(commentIndex);
+			}
+			if (idIndex != -1 && arr.GetCount() > idIndex) {
+				contactWithFields->fields.AddTail(_T("id"));
+				contactWithFields->contact.id = arr.GetAt(idIndex);
+			}
+			if (infoIndex != -1 && arr.GetCount() > infoIndex) {
+				contactWithFields->fields.AddTail(_T("info"));
+				contactWithFields->contact.info = arr.GetAt(infoIndex);
+			}
+			if (presenceIndex != -1 && arr.GetCount() > presenceIndex) {
+				contactWithFields->fields.AddTail(_T("presence"));
+				contactWithFields->contact.presence = arr.GetAt(presenceIndex) == _T("1");
+			}
+			if (directoryIndex != -1 && arr.GetCount() > directoryIndex) {
+				contactWithFields->fields.AddTail(_T("directory"));
+				contactWithFields->contact.directory = arr.GetAt(directoryIndex) == _T("1");
+			}
+			if (starredIndex != -1 && arr.GetCount() > starredIndex) {
+				contactWithFields->fields.AddTail(_T("starred"));
+				contactWithFields->contact.starred = arr.GetAt(starredIndex) == _T("1");
+			}
+			if (ContactPrepare(&contactWithFields->contact)) {
+				contactsWithFields.Add(contactWithFields);
+			}
+			else {
+				delete contactWithFields;
+			}
 		}
-		CSVFile.Close();
-		return true;
 	}
-	return false;
+	return true;
 }
 
 void Contacts::OnMenuImport()
@@ -697,6 +739,9 @@ void Contacts::OnMenuImport()
 				m_SortItemsExListCtrl.SortColumn(m_SortItemsExListCtrl.GetSortColumn(), m_SortItemsExListCtrl.IsAscending());
 			}
 		}
+		else {
+			AfxMessageBox(Translate(_T("The received data cannot be recognized")));
+		}
 	}
 }
 
@@ -802,7 +847,7 @@ bool Contacts::ContactPrepare(Contact* contact)
 void Contacts::ContactCreate(CListCtrl* list, Contact* pContact, bool subscribe)
 {
 	Contact* contact = new Contact();
-	contacts.AddTail(contact);
+	contact->position = contacts.AddTail(contact);
 	contact->image = MSIP_CONTACT_ICON_DEFAULT;
 	contact->name = pContact->name;
 	contact->number = pContact->number;
@@ -823,7 +868,15 @@ void Contacts::ContactCreate(CListCtrl* list, Contact* pContact, bool subscribe)
 	contact->presence = pContact->presence;
 	contact->directory = pContact->directory;
 	contact->starred = pContact->starred;
-	ListAppend(list, contact, subscribe);
+	index.Add(contact);
+	search.Add(contact, SearchText(contact));
+	mainDlg->pageDialer->suggest.ContactAdd(contact->number, contact->name);
+	if (list) {
+		ListAppend(list, contact, subscribe);
+	}
+	else if (subscribe && contact->presence) {
+		PresenceSubsribeOne(contact);
+	}
 }
 
 void Contacts::ListAppend(CListCtrl* list, Contact* contact, bool subscribe)
@@ -834,7 +887,7 @@ void Contacts::ListAppend(CListCtrl* list, Contact* contact, bool subscribe)
 	list->SetItemText(i, 2, Translate(contact->info.GetBuffer()));
 	if (subscribe) {
 		if (contact->presence) {
-			mainDlg->SubsribeNumber(&contact->number);
+			PresenceSubsribeOne(contact);
 		}
 	}
 }
@@ -843,9 +896,13 @@ void Contacts::ListAppend(CListCtrl* list, Contact* contact, bool subscribe)
 bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact* newContact, CStringList* fields)
 {
 	bool changed = false;
+	CString numberOld = contact->number;
+	CString nameOld = contact->name;
 	if (!fields || fields->Find(_T("name"))) {
 		if (contact->name != newContact->name) {
-			list->SetItemText(i, 0, newContact->name);
+			if (i != -1) {
+				list->SetItemText(i, 0, newContact->name);
+			}
 			contact->name = newContact->name;
 			changed = true;
 		}
@@ -857,8 +914,11 @@ bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact*
 				contact->presence = false;
 				PresenceUnsubsribeOne(contact);
 			}
-			list->SetItemText(i, 1, newContact->number);
+			if (i != -1) {
+				list->SetItemText(i, 1, newContact->number);
+			}
 			contact->number = newContact->number;
+			index.Add(contact);
 			if ((!fields || fields->Find(_T("presence")))) {
 				contact->presence = newContact->presence;
 			}
@@ -866,7 +926,7 @@ bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact*
 				contact->presence = presenceOrig;
 			}
 			if (contact->presence) {
-				mainDlg->SubsribeNumber(&contact->number);
+				PresenceSubsribeOne(contact);
 			}
 			changed = true;
 		}
@@ -886,12 +946,14 @@ bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact*
 	if (!fields || fields->Find(_T("phone"))) {
 		if (contact->phone != newContact->phone) {
 			contact->phone = newContact->phone;
+			index.Add(contact);
 			changed = true;
 		}
 	}
 	if (!fields || fields->Find(_T("mobile"))) {
 		if (contact->mobile != newContact->mobile) {
 			contact->mobile = newContact->mobile;
+			index.Add(contact);
 			changed = true;
 		}
 	}
@@ -940,7 +1002,9 @@ bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact*
 
 	if (!fields || fields->Find(_T("info"))) {
 		if ((!contact->presence || contact->info.IsEmpty()) && contact->info != newContact->info) {
-			list->SetItemText(i, 2, Translate(newContact->info.GetBuffer()));
+			if (i != -1) {
+				list->SetItemText(i, 2, Translate(newContact->info.GetBuffer()));
+			}
 			contact->info = newContact->info;
 			changed = true;
 		}
@@ -948,7 +1012,10 @@ bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact*
 	if (!fields || fields->Find(_T("starred"))) {
 		if (newContact->starred != contact->starred) {
 			contact->starred = newContact->starred;
-			list->SetItem(i, 0, LVIF_IMAGE, 0, contact->image + (contact->starred ? 7 : 0), 0, 0, 0);
+			index.Add(contact);
+			if (i != -1) {
+				list->SetItem(i, 0, LVIF_IMAGE, 0, contact->image + (contact->starred ? 7 : 0), 0, 0, 0);
+			}
 			changed = true;
 		}
 	}
@@ -956,7 +1023,7 @@ bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact*
 		if (newContact->presence != contact->presence) {
 			contact->presence = newContact->presence;
 			if (contact->presence) {
-				mainDlg->SubsribeNumber(&contact->number);
+				PresenceSubsribeOne(contact);
 			}
 			else {
 				PresenceUnsubsribeOne(contact);
@@ -964,48 +1031,200 @@ bool Contacts::ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact*
 			changed = true;
 		}
 	}
+	if (changed) {
+		search.Update(contact, SearchText(contact));
+		if (contact->number != numberOld || contact->name != nameOld) {
+			mainDlg->pageDialer->suggest.ContactRemove(numberOld, nameOld);
+			mainDlg->pageDialer->suggest.ContactAdd(contact->number, contact->name);
+		}
+	}
 	return changed;
 }
 
-void Contacts::ContactsAdd(CArray<ContactWithFields*>* contactsWithFields, bool directory)
+static const struct {
+	LPCTSTR name;
+	CString Contact::* member;
+} contactTextFields[] = {
+	{ _T("name"), &Contact::name },
+	{ _T("number"), &Contact::number },
+	{ _T("firstname"), &Contact::firstname },
+	{ _T("lastname"), &Contact::lastname },
+	{ _T("phone"), &Contact::phone },
+	{ _T("mobile"), &Contact::mobile },
+	{ _T("email"), &Contact::email },
+	{ _T("address"), &Contact::address },
+	{ _T("city"), &Contact::city },
+	{ _T("state"), &Contact::state },
+	{ _T("zip"), &Contact::zip },
+	{ _T("comment"), &Contact::comment },
+	{ _T("id"), &Contact::id },
+};
+
+// Same rules as ContactUpdate(), without touching the contact or the list.
+bool Contacts::ContactDiff(Contact* contact, Contact* newContact, CStringList* fields, CStringList* changed)
 {
-	if (isFiltered()) {
-		filterReset();
+	for (int k = 0; k < _countof(contactTextFields); k++) {
+		if (!fields || fields->Find(contactTextFields[k].name)) {
+			if (contact->*contactTextFields[k].member != newContact->*contactTextFields[k].member) {
+				changed->AddTail(contactTextFields[k].name);
+			}
+		}
 	}
-	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CONTACTS);
-	bool changedAny = false;
-	int count = list->GetItemCount();
+	if (!fields || fields->Find(_T("info"))) {
+		if ((!contact->presence || contact->info.IsEmpty()) && contact->info != newContact->info) {
+			changed->AddTail(_T("info"));
+		}
+	}
+	if (!fields || fields->Find(_T("starred"))) {
+		if (newContact->starred != contact->starred) {
+			changed->AddTail(_T("starred"));
+		}
+	}
+	if (!fields || fields->Find(_T("presence"))) {
+		if (newContact->presence != contact->presence) {
+			changed->AddTail(_T("presence"));
+		}
+	}
+	return !changed->IsEmpty();
+}
+
+// A snapshot (delta false) replaces the directory contacts when directory is set, a delta
+// only touches the contacts it lists and deletes those matched by a removed entry.
+void Contacts::ContactsDiff(CArray<ContactWithFields*>* contactsWithFields, bool directory, bool delta, ContactChanges* changes)
+{
 	int countNew = contactsWithFields->GetCount();
-	for (int i = 0; i < count; i++) {
-		Contact* contact = (Contact*)list->GetItemData(i);
-		bool found = false;
-		for (int j = 0; j < countNew; j++) {
-			ContactWithFields* contactWithFields = contactsWithFields->GetAt(j);
-			if (contact->number == contactWithFields->contact.number) {
-				contactWithFields->processed = true;
-				found = true;
-				if (ContactUpdate(list, i, contact, &contactWithFields->contact, &contactWithFields->fields)) {
-					changedAny = true;
-				}
+	CMapStringToPtr byNumber;
+	CMapStringToPtr byId;
+	byNumber.InitHashTable(countNew > 4096 ? 65521 : 4099);
+	byId.InitHashTable(countNew > 4096 ? 65521 : 4099);
+	for (int j = 0; j < countNew; j++) {
+		ContactWithFields* contactWithFields = contactsWithFields->GetAt(j);
+		void* prev;
+		if (!contactWithFields->contact.number.IsEmpty()) {
+			if (byNumber.Lookup(contactWithFields->contact.number, prev)) {
+				// a later entry for the same number replaces the earlier one
+				((ContactWithFields*)prev)->processed = true;
 			}
+			byNumber.SetAt(contactWithFields->contact.number, contactWithFields);
 		}
-		if (directory && contact->directory && !found) {
-			ContactDelete(i);
-			changedAny = true;
-			count--;
-			i--;
+		if (!contactWithFields->contact.id.IsEmpty()) {
+			byId.SetAt(contactWithFields->contact.id, contactWithFields);
+		}
+	}
+	POSITION pos = contacts.GetHeadPosition();
+	while (pos) {
+		Contact* contact = contacts.GetNext(pos);
+		void* match = NULL;
+		if (contact->id.IsEmpty() || !byId.Lookup(contact->id, match)) {
+			byNumber.Lookup(contact->number, match);
+		}
+		if (match && ((ContactWithFields*)match)->removed) {
+			((ContactWithFields*)match)->processed = true;
+			if (contact->directory) {
+				changes->deletes.SetAt(contact, contact);
+			}
+		}
+		else if (match) {
+			ContactWithFields* contactWithFields = (ContactWithFields*)match;
+			contactWithFields->processed = true;
+			CStringList changed;
+			if (ContactDiff(contact, &contactWithFields->contact, &contactWithFields->fields, &changed)) {
+				ContactChange* change = new ContactChange();
+				change->contact = contact;
+				change->newContact = &contactWithFields->contact;
+				change->fields.AddTail(&changed);
+				changes->updates.Add(change);
+			}
+		}
+		else if (directory && !delta && contact->directory) {
+			changes->deletes.SetAt(contact, contact);
 		}
 	}
 	for (int j = 0; j < countNew; j++) {
 		ContactWithFields* contactWithFields = contactsWithFields->GetAt(j);
-		if (!contactWithFields->processed) {
-			ContactCreate(list, &contactWithFields->contact);
-			changedAny = true;
+		if (!contactWithFields->processed && !contactWithFields->removed) {
+			changes->inserts.Add(&contactWithFields->contact);
 		}
 	}
-	if (changedAny) {
+}
+
+bool Contacts::ContactsAdd(CArray<ContactWithFields*>* contactsWithFields, bool directory, bool delta)
+{
+	if (delta && contactsWithFields->IsEmpty()) {
+		return false;
+	}
+	ContactChanges changes;
+	ContactsDiff(contactsWithFields, directory, delta, &changes);
+	if (changes.updates.IsEmpty() && changes.deletes.IsEmpty() && changes.inserts.IsEmpty()) {
+		return false;
+	}
+	// the changes go to the contacts, the rows of the whole list are patched in place,
+	// a filtered list or one losing many rows is filled again once
+	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CONTACTS);
+	bool refill = isFiltered() || changes.deletes.GetCount() > CONTACTS_PATCH_DELETES;
+	// each suggestion key inserted into the sorted keys moves the ones after it
+	bool batch = changes.inserts.GetCount() + changes.updates.GetCount() + changes.deletes.GetCount() > CONTACTS_SUGGEST_BATCH;
+	if (batch) {
+		mainDlg->pageDialer->suggest.BeginUpdate();
+	}
+	if (refill) {
+		for (int k = 0; k < changes.updates.GetCount(); k++) {
+			ContactChange* change = changes.updates.GetAt(k);
+			ContactUpdate(list, -1, change->contact, change->newContact, &change->fields);
+			delete change;
+		}
+		list->SetRedraw(FALSE);
+		list->DeleteAllItems();
+		POSITION pos = changes.deletes.GetStartPosition();
+		while (pos) {
+			Contact* contact;
+			Contact* value;
+			changes.deletes.GetNextAssoc(pos, contact, value);
+			ContactDeleteRaw(contact);
+		}
+		for (int k = 0; k < changes.inserts.GetCount(); k++) {
+			ContactCreate(NULL, changes.inserts.GetAt(k));
+		}
+		if (batch) {
+			mainDlg->pageDialer->suggest.EndUpdate();
+		}
+		ListFill(false);
 		ContactsSave();
+		return true;
+	}
+	list->SetRedraw(FALSE);
+	if (!changes.updates.IsEmpty() || !changes.deletes.IsEmpty()) {
+		CMap<Contact*, Contact*, int, int> rows;
+		rows.InitHashTable(65521);
+		int count = list->GetItemCount();
+		for (int i = 0; i < count; i++) {
+			rows.SetAt((Contact*)list->GetItemData(i), i);
+		}
+		for (int k = 0; k < changes.updates.GetCount(); k++) {
+			ContactChange* change = changes.updates.GetAt(k);
+			int i;
+			if (rows.Lookup(change->contact, i)) {
+				ContactUpdate(list, i, change->contact, change->newContact, &change->fields);
+			}
+			delete change;
+		}
+		// from the end, so deleting a row does not shift the ones still to visit
+		for (int i = count - 1; i >= 0 && !changes.deletes.IsEmpty(); i--) {
+			Contact* contact = (Contact*)list->GetItemData(i);
+			if (changes.deletes.RemoveKey(contact)) {
+				ContactDelete(i);
+			}
+		}
+	}
+	for (int k = 0; k < changes.inserts.GetCount(); k++) {
+		ContactCreate(list, changes.inserts.GetAt(k));
 	}
+	if (batch) {
+		mainDlg->pageDialer->suggest.EndUpdate();
+	}
+	list->SetRedraw(TRUE);
+	ContactsSave();
+	return true;
 }
 
 bool Contacts::ContactAdd(Contact contact, BOOL save, BOOL load, CStringList* fields, CString oldNumber, bool manual)
@@ -1069,112 +1288,51 @@ void Contacts::ContactDeleteRaw(Contact* contact)
 		contact->presence = false;
 		PresenceUnsubsribeOne(contact);
 	}
-	POSITION pos = contacts.Find(contact);
-	contacts.RemoveAt(pos);
+	index.Remove(contact);
+	search.Remove(contact);
+	mainDlg->pageDialer->suggest.ContactRemove(contact->number, contact->name);
+	contacts.RemoveAt(contact->position);
 	delete contact;
 }
 
+void Contacts::StoreSave()
+{
+	// directory contacts are kept by the snapshot, or are only a search cache
+	store.Save(&contacts, !mainDlg->usersDirectory.HasSnapshot() && !DirectorySearch::IsEnabled());
+}
+
 void Contacts::ContactsSave()
 {
-	if (isFiltered()) {
-		filterReset();
+	// written by the store once the changes settle
+	savePending = true;
+	SetTimer(IDT_TIMER_CONTACTS, 1000, NULL);
+}
+
+static void ContactLoaded(Contact* contact, void* param)
+{
+	Contacts* page = (Contacts*)param;
+	if (!contact->number.IsEmpty()) {
+		if (!page->isFiltered(contact)) {
+			page->ContactAdd(*contact, FALSE, TRUE);
+		}
 	}
-	CMarkup xml;
-	xml.AddElem(_T("contacts"));
-	xml.IntoElem();
+}
 
-	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CONTACTS);
-	int count = list->GetItemCount();
-	for (int i = 0; i < count; i++) {
-		Contact* pContact = (Contact*)list->GetItemData(i);
-		xml.AddElem(_T("contact"));
-		xml.AddAttrib(_T("name"), pContact->name);
-		xml.AddAttrib(_T("number"), pContact->number);
-		xml.AddAttrib(_T("firstname"), pContact->firstname);
-		xml.AddAttrib(_T("lastname"), pContact->lastname);
-		xml.AddAttrib(_T("phone"), pContact->phone);
-		xml.AddAttrib(_T("mobile"), pContact->mobile);
-		xml.AddAttrib(_T("email"), pContact->email);
-		xml.AddAttrib(_T("address"), pContact->address);
-		xml.AddAttrib(_T("city"), pContact->city);
-		xml.AddAttrib(_T("state"), pContact->state);
-		xml.AddAttrib(_T("zip"), pContact->zip);
-		xml.AddAttrib(_T("comment"), pContact->comment);
-		xml.AddAttrib(_T("id"), pContact->id);
-		xml.AddAttrib(_T("info"), pContact->info);
-		xml.AddAttrib(_T("presence"), pContact->presence ? _T("1") : _T("0"));
-		xml.AddAttrib(_T("starred"), pContact->starred ? _T("1") : _T("0"));
-		xml.AddAttrib(_T("directory"), pContact->directory ? _T("1") : _T("0"));
-	}
-
-	CString filename = accountSettings.pathRoaming;
-	filename.Append(_T("Contacts.xml"));
-	CFile file;
-	CFileException fileException;
-	if (file.Open(filename, CFile::modeCreate | CFile::modeWrite, &fileException)) {
-		CStringA str = "<?xml version=\"1.0\"?>\r\n";
-		str.Append(MSIP::Utf8EncodeUni(xml.GetDoc()));
-		file.Write(str.GetBuffer(), str.GetLength());
-		file.Close();
+static void ContactLoadedLocal(Contact* contact, void* param)
+{
+	// directory contacts come from the users directory snapshot
+	if (!contact->directory) {
+		ContactLoaded(contact, param);
 	}
 }
 
 void Contacts::ContactsLoad()
 {
-	CString filename = accountSettings.pathRoaming;
-	filename.Append(_T("Contacts.xml"));
-	CFile file;
-	CFileException fileException;
-	if (file.Open(filename, CFile::modeRead, &fileException)) {
-		CStringA data;
-		int i;
-		UINT len = 0;
-		do {
-			LPSTR p = data.GetBuffer(len + 1024);
-			i = file.Read(p + len, 1024);
-			len += i;
-			data.ReleaseBuffer(len);
-		} while (i > 0);
-		file.Close();
-		CMarkup xml;
-		BOOL bResult = xml.SetDoc(MSIP::Utf8DecodeUni(data));
-		if (bResult) {
-			if (xml.FindElem(_T("contacts"))) {
-				while (xml.FindChildElem(_T("contact"))) {
-					xml.IntoElem();
-					Contact contact;
-					contact.name = xml.GetAttrib(_T("name"));
-					contact.number = xml.GetAttrib(_T("number"));
-					contact.firstname = xml.GetAttrib(_T("firstname"));
-					contact.lastname = xml.GetAttrib(_T("lastname"));
-					contact.phone = xml.GetAttrib(_T("phone"));
-					contact.mobile = xml.GetAttrib(_T("mobile"));
-					contact.email = xml.GetAttrib(_T("email"));
-					contact.address = xml.GetAttrib(_T("address"));
-					contact.city = xml.GetAttrib(_T("city"));
-					contact.state = xml.GetAttrib(_T("state"));
-					contact.zip = xml.GetAttrib(_T("zip"));
-					contact.comment = xml.GetAttrib(_T("comment"));
-					contact.id = xml.GetAttrib(_T("id"));
-					contact.info = xml.GetAttrib(_T("info"));
-					CString rab;
-					rab = xml.GetAttrib(_T("presence"));
-					contact.presence = rab == _T("1");
-					rab = xml.GetAttrib(_T("starred"));
-					contact.starred = rab == _T("1");
-					rab = xml.GetAttrib(_T("directory"));
-					contact.directory = rab == _T("1");
-					if (!contact.number.IsEmpty()) {
-						if (!isFiltered(&contact)) {
-							ContactAdd(contact, FALSE, TRUE);
-						}
-					}
-					xml.OutOfElem();
-				}
-			}
-		}
-	}
-	else {
+	mainDlg->pageDialer->suggest.BeginUpdate();
+	// a searched directory keeps no snapshot
+	CString key = accountSettings.usersDirectory.IsEmpty() || DirectorySearch::IsEnabled() ? _T("") : mainDlg->UsersDirectoryUrl(true);
+	bool directory = mainDlg->usersDirectory.Restore(key, ContactLoaded, this);
+	if (!store.Load(directory ? ContactLoadedLocal : ContactLoaded, this)) {
 		// old
 		CString key;
 		CString val;
@@ -1195,6 +1353,7 @@ void Contacts::ContactsLoad()
 		WritePrivateProfileSection(_T("Contacts"), NULL, accountSettings.iniFile);
 		ContactsSave();
 	}
+	mainDlg->pageDialer->suggest.EndUpdate();
 	m_SortItemsExListCtrl.SortColumn(m_SortItemsExListCtrl.GetSortColumn(), m_SortItemsExListCtrl.IsAscending());
 }
 
@@ -1241,58 +1400,86 @@ void Contacts::ContactDecode(CString str, Contact& contact)
 	}
 }
 
+void Contacts::IndexRebuild()
+{
+	index.Rebuild(&contacts);
+}
+
 Contact* Contacts::FindContact(CString number, bool subscribed)
 {
-	POSITION pos = contacts.GetHeadPosition();
-	while (pos) {
-		Contact* contact = contacts.GetNext(pos);
-		if (subscribed) {
-			if (contact->presence) {
-				CString commands;
-				CString numberFormated = FormatNumber(contact->number, &commands, true);
-				if (number == numberFormated) {
+	if (subscribed) {
+		CList<Contact*>* list = index.GetByBuddy(number);
+		if (list) {
+			POSITION pos = list->GetHeadPosition();
+			while (pos) {
+				Contact* contact = list->GetNext(pos);
+				if (contact->presence) {
 					return contact;
 				}
 			}
 		}
-		else {
-			if (number == contact->number) {
-				return contact;
-			}
+	}
+	else {
+		CList<Contact*>* list = index.GetByNumber(number);
+		if (list) {
+			return list->GetHead();
 		}
-	};
+	}
 	return NULL;
 }
 
 CString Contacts::GetNameByNumber(CString number)
 {
-	CString name;
-	CString nameAlt;
-	POSITION pos = contacts.GetHeadPosition();
-	while (pos) {
-		Contact* contact = contacts.GetNext(pos);
-		CString commands;
-		CString numberContact = FormatNumber(contact->number, &commands);
-		SIPURI sipuri;
-		MSIP::ParseSIPURI(numberContact, &sipuri);
-		numberContact = !sipuri.user.IsEmpty() ? sipuri.user : sipuri.domain;
-		if (number == numberContact) {
-			name = contact->name;
-			break;
-		}
-		if (numberContact.GetLength() > 3) {
-			int pos = number.Find(numberContact);
-			if (pos >= 0 && pos <= 3 && number.GetLength() == numberContact.GetLength() + pos) {
-				nameAlt = contact->name;
-			}
+	Contact* contact = index.FindCaller(number);
+	if (contact) {
+		return contact->name;
+	}
+	return _T("");
+}
+
+int Contacts::SearchTop(CString query, int limit, CArray<Contact*>* results)
+{
+	results->RemoveAll();
+	if (query.IsEmpty()) {
+		// starred contacts, or the first ones when there are none
+		CList<Contact*>* list = index.GetStarred()->IsEmpty() ? &contacts : index.GetStarred();
+		POSITION pos = list->GetHeadPosition();
+		while (pos && results->GetCount() < limit) {
+			results->Add(list->GetNext(pos));
+		}
+		return results->GetCount();
+	}
+	// starred matches first, both parts keep the rank order
+	CArray<void*> matches;
+	search.SearchRanked(query, &matches, limit * 4);
+	CArray<Contact*> rest;
+	for (int i = 0; i < matches.GetCount(); i++) {
+		Contact* contact = (Contact*)matches.GetAt(i);
+		if (contact->starred) {
+			results->Add(contact);
 		}
-	};
-	return !name.IsEmpty() ? name : nameAlt;
+		else {
+			rest.Add(contact);
+		}
+	}
+	results->Append(rest);
+	if (results->GetCount() > limit) {
+		results->SetSize(limit);
+	}
+	return results->GetCount();
+}
+
+void Contacts::PresenceSubsribeOne(Contact* pContact)
+{
+	CString uri;
+	CString buddy = index.GetBuddyKey(pContact, &uri);
+	mainDlg->SubsribeNumber(&pContact->number, &buddy, &uri);
 }
 
 void Contacts::PresenceUnsubsribeOne(Contact* pContact)
 {
-	mainDlg->UnsubscribeNumber(&pContact->number);
+	CString buddy = index.GetBuddyKey(pContact);
+	mainDlg->UnsubscribeNumber(&pContact->number, &buddy);
 	PresenceReset(pContact);
 }
 
@@ -1302,7 +1489,7 @@ void Contacts::PresenceSubscribe()
 	while (pos) {
 		Contact* contact = contacts.GetNext(pos);
 		if (contact->presence) {
-			mainDlg->SubsribeNumber(&contact->number);
+			PresenceSubsribeOne(contact);
 		}
 	}
 }
@@ -1322,6 +1509,7 @@ void Contacts::PresenceReset(Contact* pContact)
 		if (!pContact || pContact == contact) {
 			if (contact->image != MSIP_CONTACT_ICON_DEFAULT) {
 				contact->info.Empty();
+				search.Update(contact, SearchText(contact));
 				list->SetItemText(i, 2, _T(""));
 			}
 			contact->image = MSIP_CONTACT_ICON_DEFAULT;
@@ -1335,33 +1523,27 @@ void Contacts::PresenceReceived(CString* buddyNumber, int image, bool ringing, C
 {
 	bool blink = false;
 	CListCtrl* list = (CListCtrl*)GetDlgItem(IDC_CONTACTS);
-	POSITION pos = contacts.GetHeadPosition();
+	CList<Contact*>* matches = fromUsersDirectory ? index.GetByNumber(*buddyNumber) : index.GetByBuddy(*buddyNumber);
+	POSITION pos = matches ? matches->GetHeadPosition() : NULL;
 	while (pos) {
-		Contact* contact = contacts.GetNext(pos);
+		Contact* contact = matches->GetNext(pos);
 		if (contact->presence || fromUsersDirectory) {
-			CString numberFormated;
-			if (fromUsersDirectory) {
-				numberFormated = contact->number;
-			}
-			else {
-				CString commands;
-				numberFormated = FormatNumber(contact->number, &commands, true);
+			if (ringing) {
+				blink = true;
 			}
-			if (*buddyNumber == numberFormated) {
-				if (ringing) {
-					blink = true;
-				}
-				contact->image = image;
-				contact->ringing = ringing;
+			contact->image = image;
+			contact->ringing = ringing;
+			if (contact->info != *info) {
 				contact->info = *info;
-				LVFINDINFO findInfo;
-				int i;
-				findInfo.flags = LVFI_PARAM;
-				findInfo.lParam = (LPARAM)contact;
-				if ((i = list->FindItem(&findInfo)) != -1) {
-					list->SetItem(i, 0, LVIF_IMAGE, 0, contact->image + (contact->starred ? 7 : 0), 0, 0, 0);
-					list->SetItemText(i, 2, Translate(contact->info.GetBuffer()));
-				}
+				search.Update(contact, SearchText(contact));
+			}
+			LVFINDINFO findInfo;
+			int i;
+			findInfo.flags = LVFI_PARAM;
+			findInfo.lParam = (LPARAM)contact;
+			if ((i = list->FindItem(&findInfo)) != -1) {
+				list->SetItem(i, 0, LVIF_IMAGE, 0, contact->image + (contact->starred ? 7 : 0), 0, 0, 0);
+				list->SetItemText(i, 2, Translate(contact->info.GetBuffer()));
 			}
 		}
 	};
@@ -23,6 +23,30 @@
 #include "AddDlg.h"
 #include "BaseDialog.h"
 #include "CListCtrl_SortItemsEx.h"
+#include "ContactIndex.h"
+#include "ContactStore.h"
+#include "SearchIndex.h"
+
+// deletes a change set may apply to the list rows one by one, more refill it
+#define CONTACTS_PATCH_DELETES 64
+// changes a change set may apply to the dialer suggestions one by one, more are
+// applied in one suggest update
+#define CONTACTS_SUGGEST_BATCH 256
+
+class CCSVReader;
+
+struct ContactChange {
+	Contact* contact;
+	Contact* newContact;
+	CStringList fields;
+};
+
+// result of merging an incoming contact set into the current one
+struct ContactChanges {
+	CArray<Contact*> inserts;
+	CArray<ContactChange*> updates;
+	CMap<Contact*, Contact*, Contact*, Contact*> deletes;
+};
 
 class Contacts :
 	public CBaseDialog
@@ -40,19 +64,27 @@ public:
 	AddDlg* addDlg;
 
 	CList<Contact*> contacts;
+	ContactIndex index;
+	ContactStore store;
+	SearchIndex search;
 
-	bool ContactPrepare(Contact* contact);
+	static bool ContactPrepare(Contact* contact);
 	void ContactCreate(CListCtrl* list, Contact* pContact, bool subscribe = true);
 	void ListAppend(CListCtrl* list, Contact* contact, bool subscribe = true);
+	void ListFill(bool subscribe = true);
 	bool ContactUpdate(CListCtrl* list, int i, Contact* contact, Contact* newContact, CStringList* fields);
-	void ContactsAdd(CArray<ContactWithFields*> *contacts, bool directory = false);
+	static bool ContactDiff(Contact* contact, Contact* newContact, CStringList* fields, CStringList* changed);
+	void ContactsDiff(CArray<ContactWithFields*> *contacts, bool directory, bool delta, ContactChanges* changes);
+	bool ContactsAdd(CArray<ContactWithFields*> *contacts, bool directory = false, bool delta = false);
 	bool ContactAdd(Contact contact, BOOL save = FALSE, BOOL load = FALSE, CStringList* fields = NULL, CString oldNumber = _T(""), bool manual = false);
 
 	void ContactDelete(int i);
 	void ContactDeleteRaw(Contact* contact);
 	void ContactsSave();
 	void ContactsLoad();
+	void IndexRebuild();
 	bool isFiltered(Contact *pContact = NULL);
+	static CString SearchText(Contact* contact);
 	void filterReset();
 
 	void SetCanditates();
@@ -60,6 +92,7 @@ public:
 
 	void UpdateCallButton();
 	Contact* FindContact(CString number, bool subscribed = false);
+	int SearchTop(CString query, int limit, CArray<Contact*>* results);
 	CString GetNameByNumber(CString number);
 	void PresenceSubsribeOne(Contact *pContact);
 	void PresenceUnsubsribeOne(Contact *pContact);
@@ -68,9 +101,14 @@ public:
 	void PresenceReceived(CString *buddyNumber, int image, bool ringing, CString* info, bool fromUsersDirectory = false);
 	void OnTimerContactsBlink();
 	void OnCreated();
-	bool Import(CString filename, CArray<ContactWithFields*> &contacts, bool directory = false);
+	static bool Import(CString filename, CArray<ContactWithFields*> &contacts, bool directory = false);
+	static bool Import(const char* data, int len, CArray<ContactWithFields*> &contacts, bool directory = false);
 
 private:
+	bool savePending;
+
+	void StoreSave();
+	static bool Import(CCSVReader& reader, CArray<ContactWithFields*> &contacts, bool directory);
 	void ContactDecode(CString str, Contact &contact);
 	void MessageDlgOpen(BOOL isCall = FALSE, BOOL hasVideo = FALSE, BYTE index = 0);
 	void DefaultItemAction(int i);
@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "DialSuggest.h"
+#include <math.h>
+
+static int KeyCompare(const void* a, const void* b)
+{
+	return _tcscmp(((DialSuggestKey*)a)->key, ((DialSuggestKey*)b)->key);
+}
+
+DialSuggest::DialSuggest()
+{
+	updates = 0;
+	entries.InitHashTable(65521);
+	tops.InitHashTable(4099);
+}
+
+DialSuggest::~DialSuggest()
+{
+	RemoveAll();
+}
+
+void DialSuggest::RemoveAll()
+{
+	TopsClear();
+	POSITION pos = entries.GetStartPosition();
+	while (pos) {
+		CString number;
+		void* entry;
+		entries.GetNextAssoc(pos, number, entry);
+		delete (DialSuggestEntry*)entry;
+	}
+	entries.RemoveAll();
+	keys.RemoveAll();
+	for (int i = 0; i < freed.GetCount(); i++) {
+		delete freed.GetAt(i);
+	}
+	freed.RemoveAll();
+}
+
+double DialSuggest::Score(int calls, int lastTime)
+{
+	return log((double)(1 + calls)) / log(2.0) + lastTime / (7.0 * 86400);
+}
+
+void DialSuggest::BeginUpdate()
+{
+	updates++;
+}
+
+void DialSuggest::EndUpdate()
+{
+	if (!updates || --updates) {
+		return;
+	}
+	// drop the keys removed meanwhile, sort the rest and rank every long range once
+	int live = 0;
+	for (int i = 0; i < keys.GetCount(); i++) {
+		DialSuggestKey& key = keys[i];
+		if (key.generation == key.entry->generation) {
+			if (live != i) {
+				keys[live] = key;
+			}
+			live++;
+		}
+	}
+	keys.SetSize(live);
+	for (int i = 0; i < freed.GetCount(); i++) {
+		delete freed.GetAt(i);
+	}
+	freed.RemoveAll();
+	qsort(keys.GetData(), keys.GetCount(), sizeof(DialSuggestKey), KeyCompare);
+	TopsClear();
+	int count = keys.GetCount();
+	bool heavy = true;
+	for (int len = 1; heavy; len++) {
+		heavy = false;
+		int i = 0;
+		while (i < count) {
+			if (keys[i].key.GetLength() < len) {
+				i++;
+				continue;
+			}
+			CString prefix = keys[i].key.Left(len);
+			int first;
+			int last;
+			Range(prefix, first, last);
+			if (last - first > DIAL_SUGGEST_SCAN) {
+				TopGet(prefix, first, last);
+				heavy = true;
+			}
+			i = max(last, i + 1);
+		}
+	}
+}
+
+void DialSuggest::Keys(DialSuggestEntry* entry, CStringArray& result)
+{
+	CString number = entry->number;
+	number.MakeLower();
+	result.Add(number);
+	CString digits;
+	for (int i = 0; i < number.GetLength(); i++) {
+		TCHAR c = number.GetAt(i);
+		if (c >= '0' && c <= '9') {
+			digits.AppendChar(c);
+		}
+	}
+	if (!digits.IsEmpty() && digits != number) {
+		result.Add(digits);
+	}
+	CString name = entry->name;
+	name.MakeLower();
+	int pos = 0;
+	CString word = name.Tokenize(_T(" ,.-()\"'"), pos);
+	while (!word.IsEmpty()) {
+		if (word != number && word != digits) {
+			bool found = false;
+			for (int i = 0; i < result.GetCount(); i++) {
+				if (result.GetAt(i) == word) {
+					found = true;
+					break;
+				}
+			}
+			if (!found) {
+				result.Add(word);
+			}
+		}
+		word = name.Tokenize(_T(" ,.-()\"'"), pos);
+	}
+}
+
+int DialSuggest::LowerBound(LPCTSTR key)
+{
+	int lo = 0;
+	int hi = keys.GetCount();
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (_tcscmp(keys[mid].key, key) < 0) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+void DialSuggest::Range(CString prefix, int& first, int& last)
+{
+	first = LowerBound(prefix);
+	CString next = prefix;
+	int n = next.GetLength() - 1;
+	next.SetAt(n, next.GetAt(n) + 1);
+	last = LowerBound(next);
+}
+
+void DialSuggest::KeysAdd(DialSuggestEntry* entry)
+{
+	CStringArray list;
+	Keys(entry, list);
+	for (int i = 0; i < list.GetCount(); i++) {
+		DialSuggestKey key;
+		key.key = list.GetAt(i);
+		key.entry = entry;
+		key.generation = entry->generation;
+		if (updates) {
+			keys.Add(key);
+		}
+		else {
+			keys.InsertAt(LowerBound(key.key), key);
+		}
+	}
+	if (!updates) {
+		TopsRaise(entry);
+	}
+}
+
+void DialSuggest::KeysRemove(DialSuggestEntry* entry)
+{
+	if (updates) {
+		// unsorted while updating, the keys are dropped in EndUpdate()
+		entry->generation++;
+		return;
+	}
+	TopsDrop(entry);
+	CStringArray list;
+	Keys(entry, list);
+	for (int i = 0; i < list.GetCount(); i++) {
+		for (int k = LowerBound(list.GetAt(i)); k < keys.GetCount() && keys[k].key == list.GetAt(i); k++) {
+			if (keys[k].entry == entry) {
+				keys.RemoveAt(k);
+				break;
+			}
+		}
+	}
+}
+
+void DialSuggest::TopInsert(CArray<DialSuggestEntry*>* top, DialSuggestEntry* entry)
+{
+	for (int i = 0; i < top->GetCount(); i++) {
+		if (top->GetAt(i) == entry) {
+			top->RemoveAt(i);
+			break;
+		}
+	}
+	int i = 0;
+	while (i < top->GetCount() && top->GetAt(i)->score >= entry->score) {
+		i++;
+	}
+	if (i < DIAL_SUGGEST_COUNT) {
+		top->InsertAt(i, entry);
+		if (top->GetCount() > DIAL_SUGGEST_COUNT) {
+			top->SetSize(DIAL_SUGGEST_COUNT);
+		}
+	}
+}
+
+CArray<DialSuggestEntry*>* DialSuggest::TopGet(CString prefix, int first, int last)
+{
+	void* value;
+	if (tops.Lookup(prefix, value)) {
+		return (CArray<DialSuggestEntry*>*)value;
+	}
+	CArray<DialSuggestEntry*>* top = new CArray<DialSuggestEntry*>();
+	for (int i = first; i < last; i++) {
+		DialSuggestEntry* entry = keys[i].entry;
+		if (top->GetCount() < DIAL_SUGGEST_COUNT || entry->score > top->GetAt(top->GetCount() - 1)->score) {
+			TopInsert(top, entry);
+		}
+	}
+	tops.SetAt(prefix, top);
+	return top;
+}
+
+void DialSuggest::TopsRaise(DialSuggestEntry* entry)
+{
+	CStringArray list;
+	Keys(entry, list);
+	for (int i = 0; i < list.GetCount(); i++) {
+		CString key = list.GetAt(i);
+		for (int len = 1; len <= key.GetLength(); len++) {
+			void* top;
+			if (tops.Lookup(key.Left(len), top)) {
+				TopInsert((CArray<DialSuggestEntry*>*)top, entry);
+			}
+		}
+	}
+}
+
+void DialSuggest::TopsDrop(DialSuggestEntry* entry)
+{
+	// ranges whose top held the entry are ranked again when asked for,
+	// the others do not change when it goes down or away
+	CStringArray list;
+	Keys(entry, list);
+	for (int i = 0; i < list.GetCount(); i++) {
+		CString key = list.GetAt(i);
+		for (int len = 1; len <= key.GetLength(); len++) {
+			CString prefix = key.Left(len);
+			void* value;
+			if (tops.Lookup(prefix, value)) {
+				CArray<DialSuggestEntry*>* top = (CArray<DialSuggestEntry*>*)value;
+				for (int j = 0; j < top->GetCount(); j++) {
+					if (top->GetAt(j) == entry) {
+						delete top;
+						tops.RemoveKey(prefix);
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+void DialSuggest::TopsClear()
+{
+	POSITION pos = tops.GetStartPosition();
+	while (pos) {
+		CString prefix;
+		void* top;
+		tops.GetNextAssoc(pos, prefix, top);
+		delete (CArray<DialSuggestEntry*>*)top;
+	}
+	tops.RemoveAll();
+}
+
+DialSuggestEntry* DialSuggest::EntryGet(CString number, bool create)
+{
+	void* value;
+	if (entries.Lookup(number, value)) {
+		return (DialSuggestEntry*)value;
+	}
+	if (!create) {
+		return NULL;
+	}
+	DialSuggestEntry* entry = new DialSuggestEntry();
+	entry->number = number;
+	entry->contacts = 0;
+	entry->calls = 0;
+	entry->lastTime = 0;
+	entry->score = 0;
+	entry->generation = 0;
+	entries.SetAt(number, entry);
+	return entry;
+}
+
+void DialSuggest::EntryFree(DialSuggestEntry* entry)
+{
+	KeysRemove(entry);
+	entries.RemoveKey(entry->number);
+	if (updates) {
+		freed.Add(entry);
+	}
+	else {
+		delete entry;
+	}
+}
+
+void DialSuggest::EntryRename(DialSuggestEntry* entry, CString name)
+{
+	if (entry->name != name) {
+		KeysRemove(entry);
+		entry->name = name;
+		KeysAdd(entry);
+	}
+}
+
+void DialSuggest::ContactAdd(CString number, CString name)
+{
+	if (number.IsEmpty()) {
+		return;
+	}
+	DialSuggestEntry* entry = EntryGet(number);
+	if (!entry) {
+		entry = EntryGet(number, true);
+		entry->contacts = 1;
+		entry->names.AddTail(name);
+		entry->name = name;
+		KeysAdd(entry);
+		return;
+	}
+	// the contact name replaces the one from the call log or of another contact
+	entry->contacts++;
+	entry->names.AddTail(name);
+	EntryRename(entry, name);
+}
+
+void DialSuggest::ContactRemove(CString number, CString name)
+{
+	DialSuggestEntry* entry = EntryGet(number);
+	if (entry && entry->contacts > 0) {
+		POSITION pos = entry->names.Find(name);
+		if (pos) {
+			entry->names.RemoveAt(pos);
+		}
+		if (!--entry->contacts && !entry->calls) {
+			EntryFree(entry);
+		}
+		else if (!entry->names.IsEmpty()) {
+			// the name of a contact still there
+			EntryRename(entry, entry->names.GetTail());
+		}
+	}
+}
+
+void DialSuggest::CallSet(CString number, CString name, int calls, int lastTime)
+{
+	if (number.IsEmpty()) {
+		return;
+	}
+	DialSuggestEntry* entry = EntryGet(number, calls > 0);
+	if (!entry) {
+		return;
+	}
+	if (!calls && !entry->contacts) {
+		EntryFree(entry);
+		return;
+	}
+	double score = Score(calls, lastTime);
+	bool isNew = !entry->calls && !entry->contacts;
+	bool rename = !entry->contacts && entry->name != name;
+	if (isNew || rename) {
+		if (!isNew) {
+			KeysRemove(entry);
+		}
+		entry->name = name;
+		entry->calls = calls;
+		entry->lastTime = lastTime;
+		entry->score = score;
+		KeysAdd(entry);
+		return;
+	}
+	bool raise = score >= entry->score;
+	if (!raise && !updates) {
+		TopsDrop(entry);
+	}
+	entry->calls = calls;
+	entry->lastTime = lastTime;
+	entry->score = score;
+	if (raise && !updates) {
+		TopsRaise(entry);
+	}
+}
+
+int DialSuggest::Suggest(CString text, CArray<DialSuggestEntry*>* results)
+{
+	results->RemoveAll();
+	text.Trim();
+	text.MakeLower();
+	if (text.IsEmpty() || updates) {
+		return 0;
+	}
+	int first;
+	int last;
+	Range(text, first, last);
+	if (last - first > DIAL_SUGGEST_SCAN) {
+		results->Copy(*TopGet(text, first, last));
+	}
+	else {
+		for (int i = first; i < last; i++) {
+			DialSuggestEntry* entry = keys[i].entry;
+			if (results->GetCount() < DIAL_SUGGEST_COUNT || entry->score > results->GetAt(results->GetCount() - 1)->score) {
+				TopInsert(results, entry);
+			}
+		}
+	}
+	return results->GetCount();
+}
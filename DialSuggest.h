@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "global.h"
+
+#define DIAL_SUGGEST_COUNT 10
+#define DIAL_SUGGEST_SCAN 256
+
+struct DialSuggestEntry {
+	CString number;
+	CString name;
+	int contacts;
+	int calls;
+	int lastTime;
+	double score;
+	// names of the contacts with the number, the last one is shown
+	CStringList names;
+	// bumped when the keys are removed while updating, older keys are dead
+	int generation;
+};
+
+struct DialSuggestKey {
+	CString key;
+	DialSuggestEntry* entry;
+	int generation;
+};
+
+// Dialer suggestions over contact numbers and names and the numbers of the call log.
+// The number, its digits and each word of the name of every entry are keys of one
+// sorted array, so a typed prefix is a binary searched range of it. Ranges up to
+// DIAL_SUGGEST_SCAN keys are ranked directly, longer ones keep their best entries
+// in tops, which follow score changes. Between BeginUpdate() and EndUpdate() keys
+// are appended unsorted and removed ones are only marked dead, EndUpdate() drops
+// them and sorts once.
+// The score is log2(1 + calls) plus the time of the last call in weeks: the order
+// of two entries does not change as time passes, only when one of them is called.
+class DialSuggest
+{
+public:
+	DialSuggest();
+	~DialSuggest();
+
+	void BeginUpdate();
+	void EndUpdate();
+	void ContactAdd(CString number, CString name);
+	void ContactRemove(CString number, CString name);
+	void CallSet(CString number, CString name, int calls, int lastTime);
+	void RemoveAll();
+	int Suggest(CString text, CArray<DialSuggestEntry*>* results);
+
+private:
+	CMapStringToPtr entries;
+	CArray<DialSuggestKey> keys;
+	CMapStringToPtr tops;
+	int updates;
+	// entries freed while updating, their keys go in EndUpdate()
+	CArray<DialSuggestEntry*> freed;
+
+	DialSuggestEntry* EntryGet(CString number, bool create = false);
+	void EntryFree(DialSuggestEntry* entry);
+	void EntryRename(DialSuggestEntry* entry, CString name);
+	void KeysAdd(DialSuggestEntry* entry);
+	void KeysRemove(DialSuggestEntry* entry);
+	int LowerBound(LPCTSTR key);
+	void Range(CString prefix, int& first, int& last);
+	CArray<DialSuggestEntry*>* TopGet(CString prefix, int first, int last);
+	void TopsRaise(DialSuggestEntry* entry);
+	void TopsDrop(DialSuggestEntry* entry);
+	void TopsClear();
+	static void Keys(DialSuggestEntry* entry, CStringArray& result);
+	static void TopInsert(CArray<DialSuggestEntry*>* top, DialSuggestEntry* entry);
+	static double Score(int calls, int lastTime);
+};
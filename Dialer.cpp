@@ -36,6 +36,7 @@ Dialer::Dialer(CWnd* pParent /*=NULL*/)
 	: CBaseDialog(Dialer::IDD, pParent)
 {
 	delayedDTMF = false;
+	suggesting = false;
 	m_hasVoicemail = false;
 	m_isButtonVoicemailVisible = false;
 	Create(IDD, pParent);
@@ -1073,6 +1074,7 @@ void Dialer::Input(CString digits, BOOL disableDTMF)
 	if (!disableDTMF) {
 		DTMF(digits);
 	}
+	NumberGet();
 	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
 	CEdit* edit = (CEdit*)FindWindowEx(combobox->m_hWnd, NULL, _T("EDIT"), NULL);
 	if (edit) {
@@ -1090,7 +1092,6 @@ void Dialer::DialedClear()
 }
 void Dialer::DialedLoad()
 {
-	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
 	CString key;
 	CString val;
 	LPTSTR ptr = val.GetBuffer(255);
@@ -1098,54 +1099,110 @@ void Dialer::DialedLoad()
 	while (TRUE) {
 		key.Format(_T("%d"), i);
 		if (GetPrivateProfileString(_T("Dialed"), key, NULL, ptr, 256, accountSettings.iniFile)) {
-			combobox->AddString(ptr);
+			dialed.Add(ptr);
 		}
 		else {
 			break;
 		}
 		i++;
 	}
+	DialedShow();
+}
+
+void Dialer::DialedShow()
+{
+	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
+	suggesting = false;
+	suggestions.RemoveAll();
+	combobox->ResetContent();
+	for (int i = 0; i < dialed.GetCount(); i++) {
+		combobox->AddString(dialed.GetAt(i));
+	}
 }
 
-void Dialer::DialedSave(CComboBox *combobox)
+void Dialer::DialedSave()
 {
 	CString key;
-	CString val;
 	WritePrivateProfileString(_T("Dialed"), NULL, NULL, accountSettings.iniFile);
-	for (int i = 0; i < combobox->GetCount(); i++)
+	for (int i = 0; i < dialed.GetCount(); i++)
 	{
-		int n = combobox->GetLBTextLen(i);
-		combobox->GetLBText(i, val.GetBuffer(n));
-		val.ReleaseBuffer();
-
 		key.Format(_T("%d"), i);
-		WritePrivateProfileString(_T("Dialed"), key, val, accountSettings.iniFile);
+		WritePrivateProfileString(_T("Dialed"), key, dialed.GetAt(i), accountSettings.iniFile);
 	}
 }
 
 void Dialer::DialedAdd(CString number)
 {
 	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
-	int pos = combobox->FindStringExact(-1, number);
-	if (pos == CB_ERR || pos > 0) {
-		if (pos > 0) {
-			combobox->DeleteString(pos);
+	for (int i = 0; i < dialed.GetCount(); i++) {
+		if (dialed.GetAt(i) == number) {
+			dialed.RemoveAt(i);
+			break;
+		}
+	}
+	dialed.InsertAt(0, number);
+	if (dialed.GetCount() > 10) {
+		dialed.SetSize(10);
+	}
+	DialedShow();
+	combobox->SetCurSel(0);
+	DialedSave();
+}
+
+void Dialer::SuggestShow()
+{
+	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
+	CString text;
+	combobox->GetWindowText(text);
+	if (text.IsEmpty()) {
+		if (suggesting) {
+			combobox->ShowDropDown(FALSE);
+			DialedShow();
 		}
-		else if (combobox->GetCount() >= 10)
-		{
-			combobox->DeleteString(combobox->GetCount() - 1);
+		return;
+	}
+	CArray<DialSuggestEntry*> results;
+	suggest.Suggest(text, &results);
+	// resetting the list also clears the edit part
+	DWORD sel = combobox->GetEditSel();
+	combobox->ResetContent();
+	suggesting = true;
+	suggestions.RemoveAll();
+	for (int i = 0; i < results.GetCount(); i++) {
+		DialSuggestEntry* entry = results.GetAt(i);
+		CString label = entry->number;
+		if (!entry->name.IsEmpty() && entry->name != entry->number) {
+			label.Format(_T("%s <%s>"), entry->name, entry->number);
+		}
+		if (combobox->FindStringExact(-1, label) == CB_ERR) {
+			combobox->AddString(label);
+			suggestions.SetAt(label, entry->number);
 		}
-		combobox->InsertString(0, number);
-		combobox->SetCurSel(0);
 	}
-	DialedSave(combobox);
+	combobox->ShowDropDown(results.GetCount() > 0);
+	combobox->SetWindowText(text);
+	combobox->SetEditSel(LOWORD(sel), HIWORD(sel));
+}
+
+// text of the number box, a suggestion picked from the list leaves its label
+// there and is put back as its number first
+CString Dialer::NumberGet()
+{
+	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
+	CString number;
+	combobox->GetWindowText(number);
+	CString suggested;
+	if (suggesting && suggestions.Lookup(number, suggested)) {
+		combobox->SetWindowText(suggested);
+		number = suggested;
+	}
+	return number;
 }
 
 void Dialer::SetNumber(CString  number, int callsCount)
 {
 	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
-	CString old;
-	combobox->GetWindowText(old);
+	CString old = NumberGet();
 	if (old.IsEmpty() || number.Find(old) != 0) {
 		combobox->SetWindowText(number);
 	}
@@ -1157,8 +1214,7 @@ void Dialer::UpdateCallButton(BOOL forse, int callsCount)
 {
 	int len;
 	if (!forse) {
-		CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
-		len = combobox->GetWindowTextLength();
+		len = NumberGet().GetLength();
 	}
 	else {
 		len = 1;
@@ -1236,9 +1292,7 @@ void Dialer::UpdateCallButton(BOOL forse, int callsCount)
 
 void Dialer::Action(DialerActions action)
 {
-	CString number;
-	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
-	combobox->GetWindowText(number);
+	CString number = NumberGet();
 	number.Trim();
 	if (!number.IsEmpty()) {
 		bool res = false;
@@ -1275,9 +1329,7 @@ void Dialer::OnBnClickedCall()
 
 void Dialer::OnBnClickedDTMF()
 {
-	CString number;
-	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
-	combobox->GetWindowText(number);
+	CString number = NumberGet();
 	number.Trim();
 	if (!number.IsEmpty()) {
 		DTMF(number, true);
@@ -1318,9 +1370,21 @@ void Dialer::OnBnClickedEnd()
 	}
 }
 
+// suggestions changed while shown
+void Dialer::SuggestRefresh()
+{
+	if (suggesting) {
+		SuggestShow();
+	}
+}
+
 void Dialer::OnCbnEditchangeComboAddr()
 {
 	UpdateCallButton();
+	SuggestShow();
+	CString text;
+	GetDlgItem(IDC_NUMBER)->GetWindowText(text);
+	mainDlg->UsersDirectorySearch(text);
 }
 
 void Dialer::OnCbnSelchangeComboAddr()
@@ -1397,6 +1461,7 @@ void Dialer::OnBnClickedRedial()
 
 void Dialer::OnBnClickedDelete()
 {
+	NumberGet();
 	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
 	CEdit* edit = (CEdit*)FindWindowEx(combobox->m_hWnd, NULL, _T("EDIT"), NULL);
 	if (edit) {
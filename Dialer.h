@@ -27,6 +27,7 @@
 #include "afxbutton.h"
 #include "ButtonEx.h"
 #include "ButtonBottom.h"
+#include "DialSuggest.h"
 
 enum DialerActions {
 	ACTION_CALL, ACTION_VIDEO_CALL, ACTION_MESSAGE
@@ -74,7 +75,19 @@ class Dialer :
 
 	BOOL delayedDTMF;
 
+	// the [Dialed] list, shown while the number is empty
+	CStringArray dialed;
+	// shown suggestion text to number, while suggesting
+	bool suggesting;
+	CMapStringToString suggestions;
+
+	void DialedShow();
+	void SuggestShow();
+	CString NumberGet();
+
 public:
+	void SuggestRefresh();
+	DialSuggest suggest;
 
 	CButtonBottom m_ButtonDND;
 	CButtonBottom m_ButtonFWD;
@@ -113,7 +126,7 @@ public:
 	void Input(CString digits, BOOL disableDTMF = FALSE);
 	void DialedClear();
 	void DialedLoad();
-	void DialedSave(CComboBox *combobox);
+	void DialedSave();
 	void DialedAdd(CString number);
 	void SetNumber(CString  number, int callsCount = -1);
 	void UpdateCallButton(BOOL forse = FALSE, int callsCount = -1);
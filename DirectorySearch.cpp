@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "StdAfx.h"
+#include "DirectorySearch.h"
+#include "DirectorySnapshot.h"
+#include "UsersDirectory.h"
+#include "settings.h"
+
+struct DirectorySearchFetch {
+	CString url;
+	CString query;
+	HWND hWnd;
+	UINT message;
+};
+
+DirectorySearchResult::DirectorySearchResult()
+{
+	statusCode = 0;
+	ok = false;
+}
+
+DirectorySearchResult::~DirectorySearchResult()
+{
+	for (int i = 0; i < contacts.GetCount(); i++) {
+		delete contacts.GetAt(i);
+	}
+}
+
+DirectorySearch::DirectorySearch()
+{
+	running = false;
+	pending = false;
+	pendingWnd = NULL;
+	pendingMessage = 0;
+}
+
+DirectorySearch::~DirectorySearch()
+{
+	// a running search frees its result itself once the window is gone
+	POSITION pos = queries.GetStartPosition();
+	while (pos) {
+		CString query;
+		void* entry;
+		queries.GetNextAssoc(pos, query, entry);
+		delete (DirectorySearchQuery*)entry;
+	}
+}
+
+bool DirectorySearch::IsEnabled()
+{
+	return accountSettings.usersDirectory.Find(_T("{query}")) != -1;
+}
+
+void DirectorySearch::Search(CString url, CString query, HWND hWnd, UINT message)
+{
+	query.Trim();
+	query.MakeLower();
+	if (query.GetLength() < DIRECTORY_SEARCH_MIN) {
+		current.Empty();
+		pending = false;
+		return;
+	}
+	if (query == current) {
+		return;
+	}
+	current = query;
+	if (Cached(query)) {
+		pending = false;
+		return;
+	}
+	if (running) {
+		pending = true;
+		pendingUrl = url;
+		pendingQuery = query;
+		pendingWnd = hWnd;
+		pendingMessage = message;
+		return;
+	}
+	Start(url, query, hWnd, message);
+}
+
+void DirectorySearch::Start(CString url, CString query, HWND hWnd, UINT message)
+{
+	DirectorySearchFetch* fetch = new DirectorySearchFetch();
+	fetch->url = url;
+	fetch->query = query;
+	fetch->hWnd = hWnd;
+	fetch->message = message;
+	running = true;
+	HANDLE thread = CreateThread(NULL, 0, SearchThread, fetch, 0, NULL);
+	if (thread) {
+		CloseHandle(thread);
+	}
+	else {
+		running = false;
+		delete fetch;
+	}
+}
+
+// Takes the result of a search back, returns true when its contacts are to be merged,
+// they are followed by removed entries for the contacts it pushed out of the cache.
+bool DirectorySearch::Searched(DirectorySearchResult* result)
+{
+	running = false;
+	if (pending) {
+		pending = false;
+		Start(pendingUrl, pendingQuery, pendingWnd, pendingMessage);
+	}
+	if (result->query != current) {
+		return false;
+	}
+	if (!result->ok) {
+		// asked again on the next change
+		current.Empty();
+		return false;
+	}
+	DirectorySearchQuery* entry = new DirectorySearchQuery();
+	entry->complete = result->contacts.GetCount() < DIRECTORY_SEARCH_LIMIT;
+	entry->time = GetTickCount();
+	for (int i = 0; i < result->contacts.GetCount(); i++) {
+		CString key = DirectorySnapshot::Key(&result->contacts.GetAt(i)->contact);
+		entry->keys.Add(key);
+		Touch(key);
+	}
+	QueryAdd(result->query, entry);
+	Evict(&result->contacts);
+	return true;
+}
+
+bool DirectorySearch::Cached(CString query)
+{
+	DWORD tick = GetTickCount();
+	for (int len = query.GetLength(); len >= DIRECTORY_SEARCH_MIN; len--) {
+		void* ptr;
+		if (!queries.Lookup(query.Left(len), ptr)) {
+			continue;
+		}
+		DirectorySearchQuery* entry = (DirectorySearchQuery*)ptr;
+		if (tick - entry->time >= DIRECTORY_SEARCH_TTL * 1000) {
+			QueryRemove(query.Left(len));
+			continue;
+		}
+		if (len == query.GetLength() || entry->complete) {
+			for (int i = 0; i < entry->keys.GetCount(); i++) {
+				Touch(entry->keys.GetAt(i));
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void DirectorySearch::Touch(CString key)
+{
+	void* pos;
+	if (lruKeys.Lookup(key, pos)) {
+		lru.RemoveAt((POSITION)pos);
+	}
+	lruKeys.SetAt(key, lru.AddHead(key));
+}
+
+void DirectorySearch::Evict(CArray<ContactWithFields*>* contacts)
+{
+	CMapStringToPtr evicted;
+	while (lru.GetCount() > DIRECTORY_SEARCH_CACHE) {
+		CString key = lru.RemoveTail();
+		lruKeys.RemoveKey(key);
+		evicted.SetAt(key, NULL);
+		ContactWithFields* removed = new ContactWithFields();
+		if (key.GetAt(0) == '@') {
+			removed->contact.id = key.Mid(1);
+		}
+		else {
+			removed->contact.number = key.Mid(1);
+		}
+		removed->removed = true;
+		contacts->Add(removed);
+	}
+	if (evicted.IsEmpty()) {
+		return;
+	}
+	// a query whose contacts are partly gone cannot answer from the list anymore
+	CStringArray stale;
+	POSITION pos = queries.GetStartPosition();
+	while (pos) {
+		CString query;
+		void* ptr;
+		queries.GetNextAssoc(pos, query, ptr);
+		DirectorySearchQuery* entry = (DirectorySearchQuery*)ptr;
+		for (int i = 0; i < entry->keys.GetCount(); i++) {
+			void* dummy;
+			if (evicted.Lookup(entry->keys.GetAt(i), dummy)) {
+				stale.Add(query);
+				break;
+			}
+		}
+	}
+	for (int i = 0; i < stale.GetCount(); i++) {
+		QueryRemove(stale.GetAt(i));
+	}
+}
+
+void DirectorySearch::QueryAdd(CString query, DirectorySearchQuery* entry)
+{
+	QueryRemove(query);
+	if (queries.GetCount() >= DIRECTORY_SEARCH_QUERIES) {
+		// drop the oldest
+		CString oldest;
+		DWORD age = 0;
+		DWORD tick = GetTickCount();
+		POSITION pos = queries.GetStartPosition();
+		while (pos) {
+			CString key;
+			void* ptr;
+			queries.GetNextAssoc(pos, key, ptr);
+			if (tick - ((DirectorySearchQuery*)ptr)->time >= age) {
+				age = tick - ((DirectorySearchQuery*)ptr)->time;
+				oldest = key;
+			}
+		}
+		QueryRemove(oldest);
+	}
+	queries.SetAt(query, entry);
+}
+
+void DirectorySearch::QueryRemove(CString query)
+{
+	void* ptr;
+	if (queries.Lookup(query, ptr)) {
+		delete (DirectorySearchQuery*)ptr;
+		queries.RemoveKey(query);
+	}
+}
+
+DWORD WINAPI DirectorySearch::SearchThread(LPVOID lpParam)
+{
+	DirectorySearchFetch* fetch = (DirectorySearchFetch*)lpParam;
+	DirectorySearchResult* result = new DirectorySearchResult();
+	result->query = fetch->query;
+	CString url = fetch->url;
+	url.Replace(_T("{query}"), CString(urlencode(MSIP::Utf8EncodeUni(fetch->query))));
+	url.AppendFormat(_T("%slimit=%d"), url.Find('?') == -1 ? _T("?") : _T("&"), DIRECTORY_SEARCH_LIMIT);
+	URLGetAsyncData response = URLGetSync(url);
+	result->statusCode = response.statusCode;
+	if (response.statusCode == 200 && !response.body.IsEmpty()) {
+		UsersDirectoryResult parsed;
+		CString sync;
+		UsersDirectory::Parse(response.body, response.headers, &parsed, &sync);
+		result->ok = parsed.ok;
+		for (int i = 0; i < parsed.contacts.GetCount(); i++) {
+			ContactWithFields* entry = parsed.contacts.GetAt(i);
+			if (entry->removed) {
+				delete entry;
+			}
+			else {
+				result->contacts.Add(entry);
+			}
+		}
+		parsed.contacts.RemoveAll();
+	}
+	if (!fetch->hWnd || !PostMessage(fetch->hWnd, fetch->message, (WPARAM)result, 0)) {
+		delete result;
+	}
+	delete fetch;
+	return 0;
+}
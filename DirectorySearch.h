@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#pragma once
+
+#include "global.h"
+
+// shortest query sent to the server
+#define DIRECTORY_SEARCH_MIN 2
+// matches asked for per query, fewer mean the server sent them all
+#define DIRECTORY_SEARCH_LIMIT 50
+// milliseconds of typing pause before a query is sent
+#define DIRECTORY_SEARCH_DELAY 300
+// remote contacts kept
+#define DIRECTORY_SEARCH_CACHE 2000
+// queries remembered, and for how many seconds
+#define DIRECTORY_SEARCH_QUERIES 64
+#define DIRECTORY_SEARCH_TTL 300
+
+struct DirectorySearchResult {
+	CString query;
+	DWORD statusCode;
+	bool ok;
+	CArray<ContactWithFields*> contacts;
+	DirectorySearchResult();
+	~DirectorySearchResult();
+};
+
+struct DirectorySearchQuery {
+	// keys of the contacts it returned
+	CStringArray keys;
+	// the server sent all its matches, they answer any longer query as well
+	bool complete;
+	DWORD time;
+};
+
+// Server side search of the users directory, for directories too big to download.
+// It replaces the full fetch when the directory URL has a {query} placeholder, which
+// receives the text typed in the contacts filter or the dialer, the limit parameter
+// is appended. The response is any format the full fetch accepts.
+// One query runs at a time: a query asked for while one runs replaces the one waiting,
+// and the result of a query no longer current is dropped. A query answered before (or
+// a prefix of it the server answered completely) is not sent again for a while.
+// Contacts received are merged into the contact list as directory contacts and kept
+// in a least recently used order, the ones beyond DIRECTORY_SEARCH_CACHE are removed
+// from the list again.
+class DirectorySearch
+{
+public:
+	DirectorySearch();
+	~DirectorySearch();
+
+	static bool IsEnabled();
+	void Search(CString url, CString query, HWND hWnd, UINT message);
+	bool Searched(DirectorySearchResult* result);
+
+private:
+	// query asked for last, empty when none
+	CString current;
+	bool running;
+	bool pending;
+	CString pendingUrl;
+	CString pendingQuery;
+	HWND pendingWnd;
+	UINT pendingMessage;
+	// query to DirectorySearchQuery
+	CMapStringToPtr queries;
+	// contact keys, most recently used first, and key to position
+	CStringList lru;
+	CMapStringToPtr lruKeys;
+
+	void Start(CString url, CString query, HWND hWnd, UINT message);
+	bool Cached(CString query);
+	void Touch(CString key);
+	void Evict(CArray<ContactWithFields*>* contacts);
+	void QueryAdd(CString query, DirectorySearchQuery* entry);
+	void QueryRemove(CString query);
+	static DWORD WINAPI SearchThread(LPVOID lpParam);
+};
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#include "StdAfx.h"
+#include "DirectorySnapshot.h"
+
+static CString Contact::* const snapshotFields[DIRECTORY_SNAPSHOT_FIELDS] = {
+	&Contact::name,
+	&Contact::number,
+	&Contact::firstname,
+	&Contact::lastname,
+	&Contact::phone,
+	&Contact::mobile,
+	&Contact::email,
+	&Contact::address,
+	&Contact::city,
+	&Contact::state,
+	&Contact::zip,
+	&Contact::comment,
+	&Contact::id,
+	&Contact::info,
+};
+
+struct SnapshotIndexItem {
+	const char* key;
+	UINT32 length;
+	UINT32 record;
+};
+
+DirectorySnapshot::DirectorySnapshot()
+{
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+	data = NULL;
+	header = NULL;
+	records = NULL;
+	index = NULL;
+	numberIndex = NULL;
+}
+
+DirectorySnapshot::~DirectorySnapshot()
+{
+	Close();
+}
+
+bool DirectorySnapshot::Open(CString filename)
+{
+	Close();
+	file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	DWORD size = GetFileSize(file, NULL);
+	if (size != INVALID_FILE_SIZE && size >= sizeof(DirectorySnapshotHeader)) {
+		mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+	if (data) {
+		const DirectorySnapshotHeader* h = (const DirectorySnapshotHeader*)data;
+		if (h->magic == DIRECTORY_SNAPSHOT_MAGIC
+			&& h->version == DIRECTORY_SNAPSHOT_VERSION
+			&& h->size == size
+			&& h->count <= size / sizeof(DirectorySnapshotRecord)
+			&& h->stringsOffset <= size && h->stringsSize <= size - h->stringsOffset
+			&& h->recordsOffset <= size && h->count * sizeof(DirectorySnapshotRecord) <= size - h->recordsOffset
+			&& h->indexOffset <= size && h->count * sizeof(UINT32) <= size - h->indexOffset
+			&& h->numberIndexOffset <= size && h->count * sizeof(UINT32) <= size - h->numberIndexOffset
+			) {
+			header = h;
+			records = (const DirectorySnapshotRecord*)(data + h->recordsOffset);
+			index = (const UINT32*)(data + h->indexOffset);
+			numberIndex = (const UINT32*)(data + h->numberIndexOffset);
+			return true;
+		}
+	}
+	Close();
+	return false;
+}
+
+void DirectorySnapshot::Close()
+{
+	if (data) {
+		UnmapViewOfFile(data);
+		data = NULL;
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+	header = NULL;
+	records = NULL;
+	index = NULL;
+	numberIndex = NULL;
+}
+
+int DirectorySnapshot::GetCount()
+{
+	return header ? header->count : 0;
+}
+
+CString DirectorySnapshot::GetString(const DirectorySnapshotString& str)
+{
+	if (!str.length || str.offset > header->stringsSize || str.length > header->stringsSize - str.offset) {
+		return _T("");
+	}
+	return MSIP::Utf8DecodeUni(data + header->stringsOffset + str.offset, str.length);
+}
+
+void DirectorySnapshot::Get(int i, Contact* contact)
+{
+	const DirectorySnapshotRecord* record = &records[i];
+	for (int j = 0; j < DIRECTORY_SNAPSHOT_FIELDS; j++) {
+		contact->*snapshotFields[j] = GetString(record->fields[j]);
+	}
+	contact->presence = (record->flags & DIRECTORY_SNAPSHOT_PRESENCE) != 0;
+	contact->starred = (record->flags & DIRECTORY_SNAPSHOT_STARRED) != 0;
+	contact->directory = true;
+}
+
+void DirectorySnapshot::GetValidators(CString* url, CString* etag, CString* lastModified, CString* sync)
+{
+	*url = GetString(header->url);
+	*etag = GetString(header->etag);
+	*lastModified = GetString(header->lastModified);
+	*sync = GetString(header->sync);
+}
+
+int DirectorySnapshot::Compare(const DirectorySnapshotString& str, const CStringA& key)
+{
+	if (str.offset > header->stringsSize || str.length > header->stringsSize - str.offset) {
+		return -1;
+	}
+	int len = key.GetLength();
+	int n = memcmp(data + header->stringsOffset + str.offset, (LPCSTR)key, min((int)str.length, len));
+	return n ? n : (int)str.length - len;
+}
+
+// record with the key, -1 if none
+int DirectorySnapshot::Find(CString key)
+{
+	return Search(index, false, key);
+}
+
+// a record with the number, -1 if none
+int DirectorySnapshot::FindNumber(CString number)
+{
+	return Search(numberIndex, true, number);
+}
+
+int DirectorySnapshot::Search(const UINT32* sorted, bool number, CString key)
+{
+	CStringA keyA = MSIP::Utf8EncodeUni(key);
+	int low = 0;
+	int high = GetCount() - 1;
+	while (low <= high) {
+		int mid = (low + high) / 2;
+		UINT32 record = sorted[mid];
+		if (record >= header->count) {
+			return -1;
+		}
+		int n = Compare(number ? records[record].fields[DIRECTORY_SNAPSHOT_NUMBER] : records[record].key, keyA);
+		if (!n) {
+			return record;
+		}
+		if (n < 0) {
+			low = mid + 1;
+		}
+		else {
+			high = mid - 1;
+		}
+	}
+	return -1;
+}
+
+CString DirectorySnapshot::Key(Contact* contact)
+{
+	return contact->id.IsEmpty() ? _T("#") + contact->number : _T("@") + contact->id;
+}
+
+static DirectorySnapshotString StringAdd(CStringA& strings, const CString& str)
+{
+	DirectorySnapshotString ref;
+	CStringA utf8 = MSIP::Utf8EncodeUni(str);
+	ref.offset = strings.GetLength();
+	ref.length = utf8.GetLength();
+	strings.Append(utf8);
+	return ref;
+}
+
+static int IndexItemCompare(const void* a, const void* b)
+{
+	const SnapshotIndexItem* itemA = (const SnapshotIndexItem*)a;
+	const SnapshotIndexItem* itemB = (const SnapshotIndexItem*)b;
+	int n = memcmp(itemA->key, itemB->key, min(itemA->length, itemB->length));
+	return n ? n : (int)itemA->length - (int)itemB->length;
+}
+
+bool DirectorySnapshot::Write(CString filename, CString url, CString etag, CString lastModified, CString sync, CArray<Contact*>* contacts)
+{
+	int count = contacts->GetCount();
+	DirectorySnapshotHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = DIRECTORY_SNAPSHOT_MAGIC;
+	h.version = DIRECTORY_SNAPSHOT_VERSION;
+	h.count = count;
+	CStringA strings;
+	h.url = StringAdd(strings, url);
+	h.etag = StringAdd(strings, etag);
+	h.lastModified = StringAdd(strings, lastModified);
+	h.sync = StringAdd(strings, sync);
+	CArray<DirectorySnapshotRecord> records;
+	records.SetSize(count);
+	for (int i = 0; i < count; i++) {
+		Contact* contact = contacts->GetAt(i);
+		DirectorySnapshotRecord& record = records.ElementAt(i);
+		record.key = StringAdd(strings, Key(contact));
+		for (int j = 0; j < DIRECTORY_SNAPSHOT_FIELDS; j++) {
+			record.fields[j] = StringAdd(strings, contact->*snapshotFields[j]);
+		}
+		record.flags = (contact->presence ? DIRECTORY_SNAPSHOT_PRESENCE : 0)
+			| (contact->starred ? DIRECTORY_SNAPSHOT_STARRED : 0);
+	}
+	CArray<SnapshotIndexItem> items;
+	CArray<SnapshotIndexItem> numbers;
+	items.SetSize(count);
+	numbers.SetSize(count);
+	for (int i = 0; i < count; i++) {
+		SnapshotIndexItem& item = items.ElementAt(i);
+		item.key = (LPCSTR)strings + records[i].key.offset;
+		item.length = records[i].key.length;
+		item.record = i;
+		SnapshotIndexItem& number = numbers.ElementAt(i);
+		number.key = (LPCSTR)strings + records[i].fields[DIRECTORY_SNAPSHOT_NUMBER].offset;
+		number.length = records[i].fields[DIRECTORY_SNAPSHOT_NUMBER].length;
+		number.record = i;
+	}
+	if (count) {
+		qsort(items.GetData(), count, sizeof(SnapshotIndexItem), IndexItemCompare);
+		qsort(numbers.GetData(), count, sizeof(SnapshotIndexItem), IndexItemCompare);
+	}
+	h.stringsOffset = sizeof(h);
+	h.stringsSize = strings.GetLength();
+	h.recordsOffset = (h.stringsOffset + h.stringsSize + 3) & ~3;
+	h.indexOffset = h.recordsOffset + count * sizeof(DirectorySnapshotRecord);
+	h.numberIndexOffset = h.indexOffset + count * sizeof(UINT32);
+	h.size = h.numberIndexOffset + count * sizeof(UINT32);
+	CStringA file;
+	char* p = file.GetBuffer(h.size);
+	memset(p, 0, h.size);
+	memcpy(p, &h, sizeof(h));
+	memcpy(p + h.stringsOffset, (LPCSTR)strings, h.stringsSize);
+	if (count) {
+		memcpy(p + h.recordsOffset, records.GetData(), count * sizeof(DirectorySnapshotRecord));
+	}
+	UINT32* index = (UINT32*)(p + h.indexOffset);
+	UINT32* numberIndex = (UINT32*)(p + h.numberIndexOffset);
+	for (int i = 0; i < count; i++) {
+		index[i] = items[i].record;
+		numberIndex[i] = numbers[i].record;
+	}
+	file.ReleaseBuffer(h.size);
+	return MSIP::FileReplace(filename, file);
+}
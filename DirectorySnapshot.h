@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#pragma once
+
+#include "global.h"
+
+#define DIRECTORY_SNAPSHOT_MAGIC 0x5344534D
+#define DIRECTORY_SNAPSHOT_VERSION 2
+#define DIRECTORY_SNAPSHOT_FIELDS 14
+// position of the number in the fields
+#define DIRECTORY_SNAPSHOT_NUMBER 1
+
+#define DIRECTORY_SNAPSHOT_PRESENCE 1
+#define DIRECTORY_SNAPSHOT_STARRED 2
+
+struct DirectorySnapshotString {
+	UINT32 offset;
+	UINT32 length;
+};
+
+struct DirectorySnapshotHeader {
+	UINT32 magic;
+	UINT32 version;
+	UINT32 size;
+	UINT32 count;
+	UINT32 stringsOffset;
+	UINT32 stringsSize;
+	UINT32 recordsOffset;
+	UINT32 indexOffset;
+	UINT32 numberIndexOffset;
+	DirectorySnapshotString url;
+	DirectorySnapshotString etag;
+	DirectorySnapshotString lastModified;
+	DirectorySnapshotString sync;
+};
+
+struct DirectorySnapshotRecord {
+	DirectorySnapshotString key;
+	DirectorySnapshotString fields[DIRECTORY_SNAPSHOT_FIELDS];
+	UINT32 flags;
+};
+
+// Users directory snapshot file.
+// A header, a string table (UTF-8, not terminated), one fixed size record per
+// entry and the record numbers sorted by key and by number, so Find() and
+// FindNumber() are binary searches over the mapped file and nothing is decoded
+// until Get(). The key is Key(): the id, or the number for entries without one.
+// Write() produces the whole file in one piece and replaces the old one through
+// a temporary file, Open() maps it read only and rejects files of another
+// version or with inconsistent offsets.
+class DirectorySnapshot
+{
+public:
+	DirectorySnapshot();
+	~DirectorySnapshot();
+
+	bool Open(CString filename);
+	void Close();
+	int GetCount();
+	void Get(int i, Contact* contact);
+	int Find(CString key);
+	int FindNumber(CString number);
+	void GetValidators(CString* url, CString* etag, CString* lastModified, CString* sync);
+
+	static CString Key(Contact* contact);
+	static bool Write(CString filename, CString url, CString etag, CString lastModified, CString sync, CArray<Contact*>* contacts);
+
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const char* data;
+	const DirectorySnapshotHeader* header;
+	const DirectorySnapshotRecord* records;
+	const UINT32* index;
+	const UINT32* numberIndex;
+
+	CString GetString(const DirectorySnapshotString& str);
+	int Compare(const DirectorySnapshotString& str, const CStringA& key);
+	int Search(const UINT32* sorted, bool number, CString key);
+};
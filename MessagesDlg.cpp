@@ -915,6 +915,8 @@ void MessagesDlg::OnEndCall(pjsua_call_info *call_info, call_user_data *user_dat
 	if (name.IsEmpty()) {
 		name = !sipuri.name.IsEmpty() ? sipuri.name : numberLocal;
 	}
+	// record, duration and info of the ended call are written as one journal line
+	mainDlg->pageCalls->BeginUpdate();
 	if (call_info->role == PJSIP_ROLE_UAS && call_info->connect_duration.sec == 0 && call_info->connect_duration.msec == 0) {
 		bool ignore = false;
 		bool declined = false;
@@ -941,6 +943,7 @@ void MessagesDlg::OnEndCall(pjsua_call_info *call_info, call_user_data *user_dat
 
 	mainDlg->pageCalls->SetDuration(call_info->call_id, msip_get_duration(&call_info->connect_duration));
 	mainDlg->pageCalls->SetInfo(call_info->call_id, info);
+	mainDlg->pageCalls->EndUpdate();
 	if (user_data) {
 		user_data->CS.Lock();
 		user_data->duration = msip_get_duration(&call_info->connect_duration);
@@ -502,6 +502,8 @@
 #define ID_UPDATES	32813
 #define ID_SMS 32814
 #define ID_CMD 32815
+#define ID_MOST_CALLED 32817
+#define ID_MOST_MISSED 32818
 #define ID_ACCOUNT_CHANGE_RANGE	40000
 #define ID_ACCOUNT_EDIT_RANGE	40100
 #define ID_ATTENDED_TRANSFER_RANGE	40200
@@ -514,7 +516,7 @@
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        262
-#define _APS_NEXT_COMMAND_VALUE         32817
+#define _APS_NEXT_COMMAND_VALUE         32819
 #define _APS_NEXT_CONTROL_VALUE         1205
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "SearchIndex.h"
+
+template <class TYPE>
+static void ArrayAdd(CArray<TYPE>& arr, const TYPE& value)
+{
+	INT_PTR count = arr.GetCount();
+	if (count >= 1024 && !(count & (count - 1))) {
+		// CArray grows by at most 1024 elements, double it instead
+		arr.SetSize(count, count);
+	}
+	arr.Add(value);
+}
+
+SearchIndex::SearchIndex()
+{
+	removed = 0;
+	grams.InitHashTable(65521);
+}
+
+SearchIndex::~SearchIndex()
+{
+	RemoveAll();
+}
+
+void SearchIndex::RemoveAll()
+{
+	POSITION pos = grams.GetStartPosition();
+	while (pos) {
+		CString key;
+		void* postings;
+		grams.GetNextAssoc(pos, key, postings);
+		delete (CArray<int>*)postings;
+	}
+	grams.RemoveAll();
+	docs.RemoveAll();
+	items.RemoveAll();
+	removed = 0;
+	Reset();
+}
+
+void SearchIndex::Reset()
+{
+	lastQuery.Empty();
+	lastResults.RemoveAll();
+}
+
+int SearchIndex::GetCount()
+{
+	return items.GetCount();
+}
+
+CArray<int>* SearchIndex::Postings(LPCTSTR gram, bool create)
+{
+	void* postings;
+	if (grams.Lookup(gram, postings)) {
+		return (CArray<int>*)postings;
+	}
+	if (!create) {
+		return NULL;
+	}
+	CArray<int>* list = new CArray<int>();
+	grams.SetAt(gram, list);
+	return list;
+}
+
+void SearchIndex::Add(void* item, CString text)
+{
+	int id;
+	if (items.Lookup(item, id)) {
+		Remove(item);
+	}
+	text.MakeLower();
+	id = docs.GetCount();
+	SearchIndexDocument doc;
+	doc.item = item;
+	doc.text = text;
+	ArrayAdd(docs, doc);
+	items.SetAt(item, id);
+	TCHAR gram[4];
+	int len = text.GetLength();
+	for (int i = 0; i < len; i++) {
+		for (int n = 1; n <= 3 && i + n <= len; n++) {
+			gram[n - 1] = text.GetAt(i + n - 1);
+			if (gram[n - 1] == '\n') {
+				// fields are separated by new lines, no match spans two of them
+				break;
+			}
+			gram[n] = 0;
+			CArray<int>* postings = Postings(gram, true);
+			int count = postings->GetCount();
+			if (!count || postings->GetAt(count - 1) != id) {
+				ArrayAdd(*postings, id);
+			}
+		}
+	}
+	Reset();
+}
+
+void SearchIndex::Update(void* item, CString text)
+{
+	int id;
+	if (items.Lookup(item, id)) {
+		CString lower = text;
+		lower.MakeLower();
+		if (docs.GetAt(id).text == lower) {
+			return;
+		}
+	}
+	Add(item, text);
+}
+
+void SearchIndex::Remove(void* item)
+{
+	int id;
+	if (!items.Lookup(item, id)) {
+		return;
+	}
+	items.RemoveKey(item);
+	// posting lists keep the id, dead documents are skipped by Search
+	SearchIndexDocument& doc = docs.ElementAt(id);
+	doc.item = NULL;
+	doc.text.Empty();
+	removed++;
+	Reset();
+	if (removed > 1024 && removed > items.GetCount()) {
+		Compact();
+	}
+}
+
+void SearchIndex::Compact()
+{
+	CArray<SearchIndexDocument> live;
+	for (int i = 0; i < docs.GetCount(); i++) {
+		if (docs.GetAt(i).item) {
+			live.Add(docs.GetAt(i));
+		}
+	}
+	RemoveAll();
+	for (int i = 0; i < live.GetCount(); i++) {
+		Add(live.GetAt(i).item, live.GetAt(i).text);
+	}
+}
+
+static int KeyCompare(const void* a, const void* b)
+{
+	int key1 = *(int*)a;
+	int key2 = *(int*)b;
+	return key1 > key2 ? 1 : (key1 < key2 ? -1 : 0);
+}
+
+static int PostingsCompare(const void* a, const void* b)
+{
+	CArray<int>* postings1 = *(CArray<int>**)a;
+	CArray<int>* postings2 = *(CArray<int>**)b;
+	return (int)(postings1->GetCount() - postings2->GetCount());
+}
+
+static bool PostingsContains(CArray<int>* postings, int id)
+{
+	int lo = 0;
+	int hi = postings->GetCount() - 1;
+	const int* data = postings->GetData();
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (data[mid] == id) {
+			return true;
+		}
+		if (data[mid] < id) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid - 1;
+		}
+	}
+	return false;
+}
+
+int SearchIndex::Search(CString query, CArray<void*>* results)
+{
+	results->RemoveAll();
+	query.MakeLower();
+	CArray<int> candidates;
+	CArray<int>* list = &candidates;
+	// the candidates are the matches, the list of the query itself was read
+	bool exact = false;
+	if (!lastQuery.IsEmpty() && query.Find(lastQuery) != -1) {
+		// the query was extended, only the previous matches can still match
+		candidates.Copy(lastResults);
+	}
+	else if (query.IsEmpty()) {
+		for (int i = 0; i < docs.GetCount(); i++) {
+			ArrayAdd(candidates, i);
+		}
+		exact = true;
+	}
+	else if (query.GetLength() <= 3) {
+		CArray<int>* postings = query.Find('\n') != -1 ? NULL : Postings(query);
+		if (postings) {
+			list = postings;
+			exact = true;
+		}
+	}
+	else {
+		CArray<CArray<int>*> lists;
+		CMapStringToPtr seen;
+		for (int i = 0; i + 3 <= query.GetLength(); i++) {
+			CString trigram = query.Mid(i, 3);
+			void* value;
+			if (seen.Lookup(trigram, value)) {
+				continue;
+			}
+			seen.SetAt(trigram, NULL);
+			CArray<int>* postings = Postings(trigram);
+			if (!postings) {
+				lists.RemoveAll();
+				break;
+			}
+			lists.Add(postings);
+		}
+		// a missing trigram leaves no candidates
+		if (lists.GetCount()) {
+			// walk the shortest list, probe the others
+			qsort(lists.GetData(), lists.GetCount(), sizeof(CArray<int>*), PostingsCompare);
+			CArray<int>* shortest = lists.GetAt(0);
+			for (int i = 0; i < shortest->GetCount(); i++) {
+				int id = shortest->GetAt(i);
+				bool found = true;
+				for (int j = 1; j < lists.GetCount(); j++) {
+					if (!PostingsContains(lists.GetAt(j), id)) {
+						found = false;
+						break;
+					}
+				}
+				if (found) {
+					ArrayAdd(candidates, id);
+				}
+			}
+		}
+	}
+	lastResults.RemoveAll();
+	int count = list->GetCount();
+	for (int i = 0; i < count; i++) {
+		int id = list->GetAt(i);
+		const SearchIndexDocument& doc = docs.GetAt(id);
+		if (doc.item && (exact || doc.text.Find(query) != -1)) {
+			ArrayAdd(lastResults, id);
+			ArrayAdd(*results, doc.item);
+		}
+	}
+	lastQuery = query;
+	return results->GetCount();
+}
+
+static bool IsWordStart(LPCTSTR text, int pos)
+{
+	return !pos || !_istalnum(text[pos - 1]);
+}
+
+static bool PrefixWithinOne(LPCTSTR query, int len, LPCTSTR text)
+{
+	// query equals the start of text after at most one substitution, insertion or deletion
+	int k = 0;
+	while (k < len && text[k] == query[k]) {
+		k++;
+	}
+	if (k == len) {
+		return true;
+	}
+	if (!text[k] || text[k] == '\n') {
+		return _tcsncmp(query + k + 1, text + k, len - k - 1) == 0;
+	}
+	return _tcsncmp(query + k + 1, text + k + 1, len - k - 1) == 0
+		|| _tcsncmp(query + k, text + k + 1, len - k) == 0
+		|| _tcsncmp(query + k + 1, text + k, len - k - 1) == 0;
+}
+
+int SearchIndex::Rank(const CString& query, const CString& text)
+{
+	LPCTSTR str = text;
+	int pos = text.Find(query);
+	if (pos != -1) {
+		while (pos != -1) {
+			if (IsWordStart(str, pos)) {
+				return SEARCH_RANK_WORD;
+			}
+			pos = text.Find(query, pos + 1);
+		}
+		return SEARCH_RANK_SUBSTRING;
+	}
+	int len = query.GetLength();
+	if (len >= 4) {
+		for (int i = 0; str[i]; i++) {
+			if (IsWordStart(str, i) && _istalnum(str[i]) && PrefixWithinOne(query, len, str + i)) {
+				return SEARCH_RANK_FUZZY;
+			}
+		}
+	}
+	return SEARCH_RANK_NONE;
+}
+
+void SearchIndex::SearchFuzzy(const CString& query, CArray<int>* candidates)
+{
+	// one edit changes at most three trigrams of the query
+	CArray<CArray<int>*> lists;
+	CMapStringToPtr seen;
+	for (int i = 0; i + 3 <= query.GetLength(); i++) {
+		CString trigram = query.Mid(i, 3);
+		void* value;
+		if (!seen.Lookup(trigram, value)) {
+			seen.SetAt(trigram, NULL);
+			CArray<int>* postings = Postings(trigram);
+			if (postings) {
+				lists.Add(postings);
+			}
+		}
+	}
+	int needed = max(1, (int)seen.GetCount() - 3);
+	if (lists.GetCount() < needed) {
+		return;
+	}
+	CArray<BYTE> counts;
+	counts.SetSize(docs.GetCount());
+	memset(counts.GetData(), 0, counts.GetCount());
+	for (int j = 0; j < lists.GetCount(); j++) {
+		CArray<int>* postings = lists.GetAt(j);
+		for (int i = 0; i < postings->GetCount(); i++) {
+			int id = postings->GetAt(i);
+			if (++counts[id] == needed) {
+				ArrayAdd(*candidates, id);
+			}
+		}
+	}
+	qsort(candidates->GetData(), candidates->GetCount(), sizeof(int), KeyCompare);
+}
+
+int SearchIndex::SearchRanked(CString query, CArray<void*>* results, int limit)
+{
+	query.MakeLower();
+	CArray<void*> matches;
+	Search(query, &matches);
+	CArray<void*> substrings;
+	results->RemoveAll();
+	for (int i = 0; i < lastResults.GetCount(); i++) {
+		const SearchIndexDocument& doc = docs.GetAt(lastResults.GetAt(i));
+		if (Rank(query, doc.text) == SEARCH_RANK_WORD) {
+			ArrayAdd(*results, doc.item);
+			if (limit && results->GetCount() >= limit) {
+				return results->GetCount();
+			}
+		}
+		else {
+			ArrayAdd(substrings, doc.item);
+		}
+	}
+	for (int i = 0; i < substrings.GetCount(); i++) {
+		ArrayAdd(*results, substrings.GetAt(i));
+		if (limit && results->GetCount() >= limit) {
+			return results->GetCount();
+		}
+	}
+	if (query.GetLength() >= 4 && (!limit || results->GetCount() < limit)) {
+		CArray<int> candidates;
+		SearchFuzzy(query, &candidates);
+		for (int i = 0; i < candidates.GetCount(); i++) {
+			const SearchIndexDocument& doc = docs.GetAt(candidates.GetAt(i));
+			if (doc.item && Rank(query, doc.text) == SEARCH_RANK_FUZZY) {
+				ArrayAdd(*results, doc.item);
+				if (limit && results->GetCount() >= limit) {
+					break;
+				}
+			}
+		}
+	}
+	return results->GetCount();
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+enum { SEARCH_RANK_WORD, SEARCH_RANK_SUBSTRING, SEARCH_RANK_FUZZY, SEARCH_RANK_NONE };
+
+struct SearchIndexDocument {
+	void* item;
+	CString text;
+};
+
+// Substring search over a set of items.
+// Each item is indexed by the substrings of one to three characters of its
+// lower-cased text. A query of up to three characters reads the one posting list of
+// it, a longer one intersects the lists of its trigrams and checks the candidates.
+// A query that contains the previous one only re-checks the previous result.
+// SearchRanked() orders matches by Rank(): query at the start of a word, anywhere
+// in the text, then a word start within one edit of the query.
+class SearchIndex
+{
+public:
+	SearchIndex();
+	~SearchIndex();
+
+	void Add(void* item, CString text);
+	void Update(void* item, CString text);
+	void Remove(void* item);
+	void RemoveAll();
+	int Search(CString query, CArray<void*>* results);
+	int SearchRanked(CString query, CArray<void*>* results, int limit = 0);
+	int GetCount();
+
+	// both expected in lower case
+	static int Rank(const CString& query, const CString& text);
+
+private:
+	// document ids only grow, so posting lists stay sorted
+	CArray<SearchIndexDocument> docs;
+	CMap<void*, void*, int, int> items;
+	CMapStringToPtr grams;
+	int removed;
+	CString lastQuery;
+	CArray<int> lastResults;
+
+	CArray<int>* Postings(LPCTSTR gram, bool create = false);
+	void SearchFuzzy(const CString& query, CArray<int>* candidates);
+	void Compact();
+	void Reset();
+};
@@ -72,52 +72,54 @@ BOOL Transfer::OnInitDialog()
 
 void Transfer::LoadFromContacts(Contact *selectedContact)
 {
-	ClearDropdown();
 	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
-	int selectedIndex = -1;
-	bool hasStarred = false;
-	POSITION pos = mainDlg->pageContacts->contacts.GetHeadPosition();
-	while (pos) {
-		Contact* contact = mainDlg->pageContacts->contacts.GetNext(pos);
-		if (contact->starred) {
-			hasStarred = true;
-			break;
+	combobox->SetWindowText(_T(""));
+	CArray<Contact*> matches;
+	mainDlg->pageContacts->SearchTop(_T(""), MSIP_TRANSFER_MATCHES, &matches);
+	ShowMatches(&matches);
+	if (selectedContact) {
+		int i = combobox->FindStringExact(-1, selectedContact->name);
+		if (i == CB_ERR || numbers.GetAt(combobox->GetItemData(i)) != selectedContact->number) {
+			i = combobox->InsertString(0, selectedContact->name);
+			combobox->SetItemData(i, numbers.Add(selectedContact->number));
 		}
-	};
-	pos = mainDlg->pageContacts->contacts.GetHeadPosition();
-	int i = 0;
-	while (pos) {
-		Contact* contact = mainDlg->pageContacts->contacts.GetNext(pos);
-		if (!hasStarred || contact->starred) {
-			if (selectedContact == contact) {
-				selectedIndex = i;
-			}
-			int n = combobox->AddString(contact->name);
-			CString* number = new CString(contact->number);
-			combobox->SetItemData(n, (DWORD_PTR)number);
-			i++;
-		}
-	}
-	if (selectedIndex != -1) {
-		combobox->SetCurSel(selectedIndex);
+		combobox->SetCurSel(i);
 	}
 }
 
-void Transfer::ClearDropdown()
+void Transfer::ShowMatches(CArray<Contact*>* matches)
 {
+	// the numbers are copied, a directory refresh may delete the contacts meanwhile
 	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
-	int n = combobox->GetCount();
-	for (int i = 0; i<n; i++) {
-		CString *number = (CString *)combobox->GetItemData(i);
-		delete number;
-	}
 	combobox->ResetContent();
+	numbers.RemoveAll();
+	for (int i = 0; i < matches->GetCount(); i++) {
+		Contact* contact = matches->GetAt(i);
+		int n = combobox->AddString(contact->name);
+		combobox->SetItemData(n, numbers.Add(contact->number));
+	}
+}
+
+void Transfer::OnCbnEditchangeNumber()
+{
+	CComboBox *combobox = (CComboBox*)GetDlgItem(IDC_NUMBER);
+	CString text;
+	combobox->GetWindowText(text);
+	CString query = text;
+	query.Trim();
+	CArray<Contact*> matches;
+	mainDlg->pageContacts->SearchTop(query, MSIP_TRANSFER_MATCHES, &matches);
+	// resetting the list also clears the edit part
+	DWORD sel = combobox->GetEditSel();
+	ShowMatches(&matches);
+	combobox->ShowDropDown(!query.IsEmpty() && matches.GetCount() > 0);
+	combobox->SetWindowText(text);
+	combobox->SetEditSel(LOWORD(sel), HIWORD(sel));
 }
 
 void Transfer::OnDestroy()
 {
 	mainDlg->transferDlg = NULL;
-	ClearDropdown();
 	CDialog::OnDestroy();
 }
 
@@ -136,6 +138,7 @@ BEGIN_MESSAGE_MAP(Transfer, CDialog)
 	ON_BN_CLICKED(IDCANCEL, &Transfer::OnBnClickedCancel)
 	ON_BN_CLICKED(IDC_TRANSFER_ATTENDED, &Transfer::OnBnClickedAttnded)
 	ON_BN_CLICKED(IDC_TRANSFER_BLIND, &Transfer::OnBnClickedBlind)
+	ON_CBN_EDITCHANGE(IDC_NUMBER, &Transfer::OnCbnEditchangeNumber)
 	ON_BN_CLICKED(IDC_KEY_1, &Transfer::OnBnClickedKey1)
 	ON_BN_CLICKED(IDC_KEY_2, &Transfer::OnBnClickedKey2)
 	ON_BN_CLICKED(IDC_KEY_3, &Transfer::OnBnClickedKey3)
@@ -236,7 +239,7 @@ bool Transfer::Action(msip_action action)
 		number.Trim();
 	}
 	else {
-		number = *(CString*)combobox->GetItemData(i);
+		number = numbers.GetAt(combobox->GetItemData(i));
 	}
 	if (!number.IsEmpty()) {
 		mainDlg->messagesDlg->CallAction(action, number, callId);
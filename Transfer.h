@@ -22,6 +22,8 @@
 #include "const.h"
 #include "Contacts.h"
 
+#define MSIP_TRANSFER_MATCHES 50
+
 enum msip_action {
 	MSIP_ACTION_TRANSFER,
 	MSIP_ACTION_ATTENDED_TRANSFER,
@@ -43,8 +45,10 @@ public:
 	void LoadFromContacts(Contact *selectedContact = NULL);
 protected:
 	CFont m_font;
+	// numbers of the listed contacts, item data is the position in it
+	CStringArray numbers;
 
-	void ClearDropdown();
+	void ShowMatches(CArray<Contact*>* matches);
 	afx_msg void OnDestroy();
 	virtual BOOL OnInitDialog();
 	virtual void PostNcDestroy();
@@ -58,6 +62,7 @@ public:
 	afx_msg void OnBnClickedCancel();
 	afx_msg void OnBnClickedAttnded();
 	afx_msg void OnBnClickedBlind();
+	afx_msg void OnCbnEditchangeNumber();
 	afx_msg void OnBnClickedKey1();
 	afx_msg void OnBnClickedKey2();
 	afx_msg void OnBnClickedKey3();
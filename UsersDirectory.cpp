@@ -0,0 +1,1117 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "StdAfx.h"
+#include "UsersDirectory.h"
+#include "Contacts.h"
+#include "Markup.h"
+#include "settings.h"
+
+struct UsersDirectoryFetch {
+	UsersDirectoryState* state;
+	CString url;
+	CString key;
+	int sequence;
+	HWND hWnd;
+	UINT message;
+};
+
+UsersDirectoryResult::UsersDirectoryResult()
+{
+	state = NULL;
+	statusCode = 0;
+	received = false;
+	ok = false;
+	delta = false;
+	refresh = -1;
+	timeFetch = 0;
+	timeParse = 0;
+	timeDiff = 0;
+}
+
+UsersDirectoryResult::~UsersDirectoryResult()
+{
+	for (int i = 0; i < contacts.GetCount(); i++) {
+		delete contacts.GetAt(i);
+	}
+}
+
+UsersDirectory::UsersDirectory()
+{
+	state = new UsersDirectoryState();
+	state->filename = accountSettings.pathRoaming + _T("UsersDirectory.dat");
+	snapshot = false;
+	pending = false;
+	pendingSequence = 0;
+	pendingWnd = NULL;
+	pendingMessage = 0;
+}
+
+UsersDirectory::~UsersDirectory()
+{
+	// a running fetch frees its state itself once the window is gone
+	if (state) {
+		StateFree(state);
+	}
+}
+
+// key identifies the directory across fetches, url may differ on every one ({time})
+void UsersDirectory::Load(CString url, CString key, int sequence, HWND hWnd, UINT message)
+{
+	if (!state) {
+		pending = true;
+		pendingUrl = url;
+		pendingKey = key;
+		pendingSequence = sequence;
+		pendingWnd = hWnd;
+		pendingMessage = message;
+		return;
+	}
+	UsersDirectoryFetch* fetch = new UsersDirectoryFetch();
+	fetch->state = state;
+	fetch->url = url;
+	fetch->key = key;
+	fetch->sequence = sequence;
+	fetch->hWnd = hWnd;
+	fetch->message = message;
+	state = NULL;
+	HANDLE thread = CreateThread(NULL, 0, FetchThread, fetch, 0, NULL);
+	if (thread) {
+		CloseHandle(thread);
+	}
+	else {
+		FetchThread(fetch);
+	}
+}
+
+void UsersDirectory::Loaded(UsersDirectoryResult* result)
+{
+	state = result->state;
+	result->state = NULL;
+	if (result->ok) {
+		snapshot = state->loaded;
+	}
+	if (pending) {
+		pending = false;
+		Load(pendingUrl, pendingKey, pendingSequence, pendingWnd, pendingMessage);
+	}
+}
+
+// Adds the directory contacts of the snapshot file and resumes from it, to be called
+// at startup before the first Load() with the key it will get. A snapshot of another
+// directory, or any when key is empty, is deleted.
+bool UsersDirectory::Restore(CString key, ContactStoreProc proc, void* param)
+{
+	if (!state || !state->snapshot.Open(state->filename)) {
+		return false;
+	}
+	CString etag, lastModified, sync;
+	state->snapshot.GetValidators(&state->key, &etag, &lastModified, &sync);
+	if (key.IsEmpty() || key != state->key) {
+		state->snapshot.Close();
+		state->key.Empty();
+		DeleteFile(state->filename);
+		return false;
+	}
+	int count = state->snapshot.GetCount();
+	for (int i = 0; i < count; i++) {
+		Contact contact;
+		state->snapshot.Get(i, &contact);
+		proc(&contact, param);
+	}
+	state->etag = etag;
+	state->lastModified = lastModified;
+	state->sync = sync;
+	state->loaded = true;
+	snapshot = true;
+	return true;
+}
+
+bool UsersDirectory::HasSnapshot()
+{
+	return snapshot;
+}
+
+DWORD WINAPI UsersDirectory::FetchThread(LPVOID lpParam)
+{
+	UsersDirectoryFetch* fetch = (UsersDirectoryFetch*)lpParam;
+	UsersDirectoryState* state = fetch->state;
+	UsersDirectoryResult* result = new UsersDirectoryResult();
+	result->state = state;
+	if (fetch->key != state->key) {
+		state->key = fetch->key;
+		state->etag.Empty();
+		state->lastModified.Empty();
+		state->sync.Empty();
+		ModelClear(state);
+	}
+	DWORD tick = GetTickCount();
+	URLGetAsyncData response;
+	while (true) {
+		CString headers;
+		if (!state->etag.IsEmpty()) {
+			headers.AppendFormat(_T("If-None-Match: %s\r\n"), state->etag);
+		}
+		if (!state->lastModified.IsEmpty()) {
+			headers.AppendFormat(_T("If-Modified-Since: %s\r\n"), state->lastModified);
+		}
+		CString url = fetch->url;
+		url.AppendFormat(_T("%ssequence=%d"), url.Find('?') == -1 ? _T("?") : _T("&"), fetch->sequence);
+		if (!state->sync.IsEmpty()) {
+			url.AppendFormat(_T("&sync=%s"), CString(urlencode(MSIP::Utf8EncodeUni(state->sync))));
+		}
+		response = URLGetSync(url, false, _T(""), headers);
+		if (response.statusCode == HTTP_STATUS_GONE && !state->sync.IsEmpty()) {
+			// token rejected, ask for a snapshot
+			state->sync.Empty();
+			continue;
+		}
+		break;
+	}
+	result->timeFetch = GetTickCount() - tick;
+	result->statusCode = response.statusCode;
+	result->headers = response.headers;
+	if (response.statusCode == 200 && !response.body.IsEmpty()) {
+		result->received = true;
+		CString sync;
+		tick = GetTickCount();
+		Parse(response.body, response.headers, result, &sync);
+		result->timeParse = GetTickCount() - tick;
+		if (result->ok) {
+			state->etag = HttpHeaderGet(response.headers, _T("ETag"));
+			state->lastModified = HttpHeaderGet(response.headers, _T("Last-Modified"));
+			state->sync = sync;
+			tick = GetTickCount();
+			Diff(state, result);
+			result->timeDiff = GetTickCount() - tick;
+			if (!state->loaded) {
+				// nothing to apply a 304 or a delta to
+				state->etag.Empty();
+				state->lastModified.Empty();
+				state->sync.Empty();
+			}
+		}
+		else {
+			state->etag.Empty();
+			state->lastModified.Empty();
+			state->sync.Empty();
+			ModelClear(state);
+		}
+	}
+	if (!fetch->hWnd || !PostMessage(fetch->hWnd, fetch->message, (WPARAM)result, 0)) {
+		StateFree(result->state);
+		delete result;
+	}
+	delete fetch;
+	return 0;
+}
+
+void UsersDirectory::Parse(CStringA& body, CString& headers, UsersDirectoryResult* result, CString* sync)
+{
+	if (headers.Find(_T("Content-Type: text/csv")) != -1) {
+		ParseCSV(body, result);
+	}
+	else if (!ParseJSON(body, result, sync)) {
+		ParseXML(body, result, sync);
+	}
+}
+
+void UsersDirectory::ParseCSV(CStringA& body, UsersDirectoryResult* result)
+{
+	if (Contacts::Import(body, body.GetLength(), result->contacts)) {
+		result->ok = true;
+	}
+}
+
+// Single pass reader for the JSON directory payload, values are decoded as they are
+// reached and item members go straight into the ContactWithFields, no tree is built.
+struct JsonCursor {
+	const char* p;
+	const char* end;
+	bool error;
+};
+
+static void JsonSpace(JsonCursor* c)
+{
+	while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\r' || *c->p == '\n')) {
+		c->p++;
+	}
+}
+
+static bool JsonExpect(JsonCursor* c, char ch)
+{
+	JsonSpace(c);
+	if (c->p < c->end && *c->p == ch) {
+		c->p++;
+		return true;
+	}
+	c->error = true;
+	return false;
+}
+
+static char JsonPeek(JsonCursor* c)
+{
+	JsonSpace(c);
+	return c->p < c->end ? *c->p : 0;
+}
+
+// true while another element of the array or object follows, consumes the separator
+// or the closing bracket
+static bool JsonNext(JsonCursor* c, char close, bool* first)
+{
+	char ch = JsonPeek(c);
+	if (ch == close) {
+		c->p++;
+		return false;
+	}
+	if (*first) {
+		*first = false;
+		if (ch) {
+			return true;
+		}
+	}
+	else if (ch == ',') {
+		c->p++;
+		return true;
+	}
+	c->error = true;
+	return false;
+}
+
+static int JsonHex(JsonCursor* c)
+{
+	if (c->end - c->p < 4) {
+		c->error = true;
+		return 0;
+	}
+	int value = 0;
+	for (int i = 0; i < 4; i++) {
+		char ch = *c->p++;
+		value <<= 4;
+		if (ch >= '0' && ch <= '9') {
+			value |= ch - '0';
+		}
+		else if (ch >= 'a' && ch <= 'f') {
+			value |= ch - 'a' + 10;
+		}
+		else if (ch >= 'A' && ch <= 'F') {
+			value |= ch - 'A' + 10;
+		}
+		else {
+			c->error = true;
+		}
+	}
+	return value;
+}
+
+static void JsonUtf8Append(CStringA& str, unsigned int code)
+{
+	if (code < 0x80) {
+		str += (char)code;
+	}
+	else if (code < 0x800) {
+		str += (char)(0xC0 | (code >> 6));
+		str += (char)(0x80 | (code & 0x3F));
+	}
+	else if (code < 0x10000) {
+		str += (char)(0xE0 | (code >> 12));
+		str += (char)(0x80 | ((code >> 6) & 0x3F));
+		str += (char)(0x80 | (code & 0x3F));
+	}
+	else {
+		str += (char)(0xF0 | (code >> 18));
+		str += (char)(0x80 | ((code >> 12) & 0x3F));
+		str += (char)(0x80 | ((code >> 6) & 0x3F));
+		str += (char)(0x80 | (code & 0x3F));
+	}
+}
+
+// reads a string, value may be NULL to skip it
+static bool JsonString(JsonCursor* c, CString* value)
+{
+	if (!JsonExpect(c, '"')) {
+		return false;
+	}
+	const char* start = c->p;
+	while (c->p < c->end && *c->p != '"' && *c->p != '\\') {
+		c->p++;
+	}
+	if (c->p >= c->end) {
+		c->error = true;
+		return false;
+	}
+	if (*c->p == '"') {
+		if (value) {
+			*value = MSIP::Utf8DecodeUni(start, (int)(c->p - start));
+		}
+		c->p++;
+		return true;
+	}
+	CStringA str(start, (int)(c->p - start));
+	while (c->p < c->end && *c->p != '"') {
+		if (*c->p != '\\') {
+			str += *c->p++;
+			continue;
+		}
+		if (++c->p >= c->end) {
+			break;
+		}
+		char ch = *c->p++;
+		switch (ch) {
+		case 'b': str += '\b'; break;
+		case 'f': str += '\f'; break;
+		case 'n': str += '\n'; break;
+		case 'r': str += '\r'; break;
+		case 't': str += '\t'; break;
+		case 'u': {
+			unsigned int code = JsonHex(c);
+			if (code >= 0xD800 && code < 0xDC00 && c->end - c->p >= 6 && c->p[0] == '\\' && c->p[1] == 'u') {
+				c->p += 2;
+				unsigned int low = JsonHex(c);
+				if (low >= 0xDC00 && low < 0xE000) {
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+				else {
+					c->error = true;
+				}
+			}
+			JsonUtf8Append(str, code);
+			break;
+		}
+		default:
+			str += ch;
+		}
+	}
+	if (c->error || c->p >= c->end) {
+		c->error = true;
+		return false;
+	}
+	c->p++;
+	if (value) {
+		*value = MSIP::Utf8DecodeUni(str, str.GetLength());
+	}
+	return true;
+}
+
+// member name as raw bytes, names are compared unescaped
+static bool JsonName(JsonCursor* c, const char** name, int* len)
+{
+	if (!JsonExpect(c, '"')) {
+		return false;
+	}
+	*name = c->p;
+	while (c->p < c->end && *c->p != '"') {
+		if (*c->p == '\\') {
+			c->p++;
+		}
+		c->p++;
+	}
+	if (c->p >= c->end) {
+		c->error = true;
+		return false;
+	}
+	*len = (int)(c->p - *name);
+	c->p++;
+	return JsonExpect(c, ':');
+}
+
+static bool JsonNameIs(const char* name, int len, const char* str)
+{
+	return (int)strlen(str) == len && !memcmp(name, str, len);
+}
+
+// reads a number, integral is cleared for fractions and exponents
+static bool JsonNumber(JsonCursor* c, int* value, bool* integral)
+{
+	JsonSpace(c);
+	const char* start = c->p;
+	*integral = true;
+	while (c->p < c->end && (*c->p == '-' || *c->p == '+' || (*c->p >= '0' && *c->p <= '9')
+		|| *c->p == '.' || *c->p == 'e' || *c->p == 'E')) {
+		if (*c->p == '.' || *c->p == 'e' || *c->p == 'E') {
+			*integral = false;
+		}
+		c->p++;
+	}
+	if (c->p == start) {
+		c->error = true;
+		return false;
+	}
+	*value = *integral ? atoi(start) : 0;
+	return true;
+}
+
+static bool JsonSkip(JsonCursor* c)
+{
+	bool first = true;
+	const char* name;
+	int len;
+	switch (JsonPeek(c)) {
+	case '"':
+		return JsonString(c, NULL);
+	case '{':
+		c->p++;
+		while (JsonNext(c, '}', &first)) {
+			if (!JsonName(c, &name, &len) || !JsonSkip(c)) {
+				return false;
+			}
+		}
+		break;
+	case '[':
+		c->p++;
+		while (JsonNext(c, ']', &first)) {
+			if (!JsonSkip(c)) {
+				return false;
+			}
+		}
+		break;
+	case 't':
+	case 'f':
+	case 'n':
+		while (c->p < c->end && *c->p >= 'a' && *c->p <= 'z') {
+			c->p++;
+		}
+		break;
+	default: {
+		int value;
+		bool integral;
+		return JsonNumber(c, &value, &integral);
+	}
+	}
+	return !c->error;
+}
+
+// string member if the value is a string, anything else is skipped
+static bool JsonStringMember(JsonCursor* c, CString* value, bool* present)
+{
+	if (JsonPeek(c) != '"') {
+		return JsonSkip(c);
+	}
+	*present = true;
+	return JsonString(c, value);
+}
+
+// integer member if the value is an integer, anything else is skipped
+static bool JsonIntMember(JsonCursor* c, int* value, bool* present)
+{
+	char ch = JsonPeek(c);
+	if (ch != '-' && (ch < '0' || ch > '9')) {
+		return JsonSkip(c);
+	}
+	bool integral;
+	if (!JsonNumber(c, value, &integral)) {
+		return false;
+	}
+	*present = integral;
+	return true;
+}
+
+static const struct {
+	const char* key;
+	CString Contact::* field;
+} jsonItemFields[] = {
+	{ "name", &Contact::name },
+	{ "number", &Contact::number },
+	{ "firstname", &Contact::firstname },
+	{ "lastname", &Contact::lastname },
+	{ "phone", &Contact::phone },
+	{ "mobile", &Contact::mobile },
+	{ "email", &Contact::email },
+	{ "address", &Contact::address },
+	{ "city", &Contact::city },
+	{ "state", &Contact::state },
+	{ "zip", &Contact::zip },
+	{ "comment", &Contact::comment },
+	{ "id", &Contact::id },
+	{ "info", &Contact::info },
+};
+
+#define JSON_ITEM_FIELDS (int)(sizeof(jsonItemFields) / sizeof(jsonItemFields[0]))
+
+static bool JsonItem(JsonCursor* c, UsersDirectoryResult* result)
+{
+	if (JsonPeek(c) != '{') {
+		return JsonSkip(c);
+	}
+	c->p++;
+	ContactWithFields* contactWithFields = new ContactWithFields();
+	Contact* contact = &contactWithFields->contact;
+	contact->directory = true;
+	bool present[JSON_ITEM_FIELDS] = { false };
+	CString telephone;
+	bool hasTelephone = false;
+	int presence = 0, starred = 0, removed = 0;
+	bool hasPresence = false, hasStarred = false, hasRemoved = false;
+	bool first = true;
+	const char* name;
+	int len;
+	while (!c->error && JsonNext(c, '}', &first)) {
+		if (!JsonName(c, &name, &len)) {
+			break;
+		}
+		int i = 0;
+		while (i < JSON_ITEM_FIELDS && !JsonNameIs(name, len, jsonItemFields[i].key)) {
+			i++;
+		}
+		if (i < JSON_ITEM_FIELDS) {
+			JsonStringMember(c, &(contact->*jsonItemFields[i].field), &present[i]);
+		}
+		else if (JsonNameIs(name, len, "telephone")) {
+			JsonStringMember(c, &telephone, &hasTelephone);
+		}
+		else if (JsonNameIs(name, len, "presence")) {
+			JsonIntMember(c, &presence, &hasPresence);
+		}
+		else if (JsonNameIs(name, len, "starred")) {
+			JsonIntMember(c, &starred, &hasStarred);
+		}
+		else if (JsonNameIs(name, len, "removed")) {
+			JsonIntMember(c, &removed, &hasRemoved);
+		}
+		else {
+			JsonSkip(c);
+		}
+	}
+	if (c->error) {
+		delete contactWithFields;
+		return false;
+	}
+	// number falls back to phone, then to telephone
+	if (!present[1]) {
+		if (present[4]) {
+			contact->number = contact->phone;
+			present[1] = true;
+		}
+		else if (hasTelephone) {
+			contact->number = telephone;
+			present[1] = true;
+		}
+	}
+	for (int i = 0; i < JSON_ITEM_FIELDS; i++) {
+		if (present[i]) {
+			contactWithFields->fields.AddTail(CString(jsonItemFields[i].key));
+		}
+	}
+	if (hasPresence) {
+		contactWithFields->fields.AddTail(_T("presence"));
+		contact->presence = presence != 0;
+	}
+	if (hasStarred) {
+		contactWithFields->fields.AddTail(_T("starred"));
+		contact->starred = starred != 0;
+	}
+	if (result->delta && hasRemoved && removed) {
+		// a removal may carry the number in phone or mobile only
+		contactWithFields->removed = true;
+		Contacts::ContactPrepare(contact);
+		result->contacts.Add(contactWithFields);
+	}
+	else if (Contacts::ContactPrepare(contact)) {
+		result->contacts.Add(contactWithFields);
+	}
+	else {
+		delete contactWithFields;
+	}
+	return true;
+}
+
+static bool JsonItems(JsonCursor* c, UsersDirectoryResult* result)
+{
+	if (JsonPeek(c) != '[') {
+		return JsonSkip(c);
+	}
+	c->p++;
+	bool first = true;
+	while (JsonNext(c, ']', &first)) {
+		if (!JsonItem(c, result)) {
+			break;
+		}
+	}
+	return !c->error;
+}
+
+static int JsonPresenceImage(CString& status, bool* ringing)
+{
+	*ringing = false;
+	if (status == _T("offline")) {
+		return MSIP_CONTACT_ICON_OFFLINE;
+	}
+	if (status == _T("online")) {
+		return MSIP_CONTACT_ICON_ONLINE;
+	}
+	if (status == _T("away")) {
+		return MSIP_CONTACT_ICON_AWAY;
+	}
+	if (status == _T("busy")) {
+		return MSIP_CONTACT_ICON_BUSY;
+	}
+	if (status == _T("ring")) {
+		*ringing = true;
+		return MSIP_CONTACT_ICON_ON_THE_PHONE;
+	}
+	if (status == _T("phone")) {
+		return MSIP_CONTACT_ICON_ON_THE_PHONE;
+	}
+	return MSIP_CONTACT_ICON_UNKNOWN;
+}
+
+static bool JsonPresence(JsonCursor* c, UsersDirectoryResult* result)
+{
+	if (JsonPeek(c) != '[') {
+		return JsonSkip(c);
+	}
+	c->p++;
+	bool first = true;
+	while (JsonNext(c, ']', &first)) {
+		if (JsonPeek(c) != '{') {
+			if (!JsonSkip(c)) {
+				break;
+			}
+			continue;
+		}
+		c->p++;
+		CString number, status, info;
+		bool hasNumber = false, hasStatus = false, hasInfo = false;
+		bool firstMember = true;
+		const char* name;
+		int len;
+		while (!c->error && JsonNext(c, '}', &firstMember)) {
+			if (!JsonName(c, &name, &len)) {
+				break;
+			}
+			if (JsonNameIs(name, len, "number")) {
+				JsonStringMember(c, &number, &hasNumber);
+			}
+			else if (JsonNameIs(name, len, "status")) {
+				JsonStringMember(c, &status, &hasStatus);
+			}
+			else if (JsonNameIs(name, len, "info")) {
+				JsonStringMember(c, &info, &hasInfo);
+			}
+			else {
+				JsonSkip(c);
+			}
+		}
+		if (c->error) {
+			break;
+		}
+		if (hasNumber && hasStatus) {
+			Prensence prensence;
+			prensence.number = number;
+			prensence.image = JsonPresenceImage(status, &prensence.ringing);
+			prensence.info = info;
+			result->prensences.AddTail(prensence);
+		}
+	}
+	return !c->error;
+}
+
+static void JsonClear(UsersDirectoryResult* result)
+{
+	for (int i = 0; i < result->contacts.GetCount(); i++) {
+		delete result->contacts.GetAt(i);
+	}
+	result->contacts.RemoveAll();
+}
+
+// The root is either an array of items or an object with refresh, sync, items or
+// changes (items wins when both are sent) and presence members, in any order.
+// Returns false when the body is not JSON, nothing is kept from it then.
+bool UsersDirectory::ParseJSON(CStringA& body, UsersDirectoryResult* result, CString* sync)
+{
+	JsonCursor c;
+	c.p = body;
+	c.end = c.p + body.GetLength();
+	c.error = false;
+	char ch = JsonPeek(&c);
+	if (ch == '[') {
+		if (JsonItems(&c, result)) {
+			result->ok = true;
+		}
+	}
+	else if (ch == '{') {
+		c.p++;
+		bool items = false;
+		bool first = true;
+		const char* name;
+		int len;
+		while (!c.error && JsonNext(&c, '}', &first)) {
+			if (!JsonName(&c, &name, &len)) {
+				break;
+			}
+			if (JsonNameIs(name, len, "refresh")) {
+				int refresh;
+				bool present = false;
+				if (JsonIntMember(&c, &refresh, &present) && present) {
+					result->refresh = refresh;
+				}
+			}
+			else if (JsonNameIs(name, len, "sync")) {
+				bool present = false;
+				CString value;
+				if (JsonStringMember(&c, &value, &present) && present) {
+					*sync = value;
+				}
+			}
+			else if (JsonNameIs(name, len, "items") && JsonPeek(&c) == '[') {
+				JsonClear(result);
+				result->delta = false;
+				result->ok = true;
+				items = true;
+				JsonItems(&c, result);
+			}
+			else if (JsonNameIs(name, len, "changes") && !items && JsonPeek(&c) == '[') {
+				JsonClear(result);
+				result->delta = true;
+				result->ok = true;
+				JsonItems(&c, result);
+			}
+			else if (JsonNameIs(name, len, "presence")) {
+				JsonPresence(&c, result);
+			}
+			else {
+				JsonSkip(&c);
+			}
+		}
+	}
+	else {
+		c.error = true;
+	}
+	if (c.error) {
+		JsonClear(result);
+		result->prensences.RemoveAll();
+		result->refresh = -1;
+		result->delta = false;
+		result->ok = false;
+		sync->Empty();
+		return false;
+	}
+	return true;
+}
+
+void UsersDirectory::ParseXML(CStringA& body, UsersDirectoryResult* result, CString* sync)
+{
+	ContactWithFields* contactWithFields;
+	CMarkup xml;
+	BOOL bResult = xml.SetDoc(MSIP::Utf8DecodeUni(body));
+	if (bResult) {
+		result->ok = true;
+		if (xml.FindElem(_T("contacts")) || xml.FindElem(_T("changes"))) {
+			result->delta = xml.GetTagName() == _T("changes");
+			if (xml.FindAttrib(_T("refresh"))) {
+				result->refresh = _wtoi(xml.GetAttrib(_T("refresh")));
+			}
+			if (xml.FindAttrib(_T("sync"))) {
+				*sync = xml.GetAttrib(_T("sync"));
+			}
+			while (xml.FindChildElem(_T("contact"))) {
+				xml.IntoElem();
+				contactWithFields = new ContactWithFields();
+				contactWithFields->contact.directory = true;
+				if (xml.FindAttrib(_T("name"))) {
+					contactWithFields->fields.AddTail(_T("name"));
+					contactWithFields->contact.name = xml.GetAttrib(_T("name"));
+				}
+				if (xml.FindAttrib(_T("number"))) {
+					contactWithFields->fields.AddTail(_T("number"));
+					contactWithFields->contact.number = xml.GetAttrib(_T("number"));
+				}
+				if (xml.FindAttrib(_T("firstname"))) {
+					contactWithFields->fields.AddTail(_T("firstname"));
+					contactWithFields->contact.firstname = xml.GetAttrib(_T("firstname"));
+				}
+				if (xml.FindAttrib(_T("lastname"))) {
+					contactWithFields->fields.AddTail(_T("lastname"));
+					contactWithFields->contact.lastname = xml.GetAttrib(_T("lastname"));
+				}
+				if (xml.FindAttrib(_T("phone"))) {
+					contactWithFields->fields.AddTail(_T("phone"));
+					contactWithFields->contact.phone = xml.GetAttrib(_T("phone"));
+				}
+				if (xml.FindAttrib(_T("mobile"))) {
+					contactWithFields->fields.AddTail(_T("mobile"));
+					contactWithFields->contact.mobile = xml.GetAttrib(_T("mobile"));
+				}
+				if (xml.FindAttrib(_T("email"))) {
+					contactWithFields->fields.AddTail(_T("email"));
+					contactWithFields->contact.email = xml.GetAttrib(_T("email"));
+				}
+				if (xml.FindAttrib(_T("address"))) {
+					contactWithFields->fields.AddTail(_T("address"));
+					contactWithFields->contact.address = xml.GetAttrib(_T("address"));
+				}
+				if (xml.FindAttrib(_T("city"))) {
+					contactWithFields->fields.AddTail(_T("city"));
+					contactWithFields->contact.city = xml.GetAttrib(_T("city"));
+				}
+				if (xml.FindAttrib(_T("state"))) {
+					contactWithFields->fields.AddTail(_T("state"));
+					contactWithFields->contact.state = xml.GetAttrib(_T("state"));
+				}
+				if (xml.FindAttrib(_T("zip"))) {
+					contactWithFields->fields.AddTail(_T("zip"));
+					contactWithFields->contact.zip = xml.GetAttrib(_T("zip"));
+				}
+				if (xml.FindAttrib(_T("comment"))) {
+					contactWithFields->fields.AddTail(_T("comment"));
+					contactWithFields->contact.comment = xml.GetAttrib(_T("comment"));
+				}
+				if (xml.FindAttrib(_T("id"))) {
+					contactWithFields->fields.AddTail(_T("id"));
+					contactWithFields->contact.id = xml.GetAttrib(_T("id"));
+				}
+				if (xml.FindAttrib(_T("info"))) {
+					contactWithFields->fields.AddTail(_T("info"));
+					contactWithFields->contact.info = xml.GetAttrib(_T("info"));
+				}
+				if (xml.FindAttrib(_T("presence"))) {
+					contactWithFields->fields.AddTail(_T("presence"));
+					CString rab = xml.GetAttrib(_T("presence"));
+					contactWithFields->contact.presence = rab == _T("1");
+				}
+				if (xml.FindAttrib(_T("starred"))) {
+					contactWithFields->fields.AddTail(_T("starred"));
+					CString rab = xml.GetAttrib(_T("starred"));
+					contactWithFields->contact.starred = rab == _T("1");
+				}
+				if (result->delta && xml.GetAttrib(_T("removed")) == _T("1")) {
+					contactWithFields->removed = true;
+					Contacts::ContactPrepare(&contactWithFields->contact);
+					result->contacts.Add(contactWithFields);
+				}
+				else if (Contacts::ContactPrepare(&contactWithFields->contact)) {
+					result->contacts.Add(contactWithFields);
+				}
+				else {
+					delete contactWithFields;
+				}
+				xml.OutOfElem();
+			}
+		}
+		else if (xml.FindElem(_T("YealinkIPPhoneBook"))) {
+			while (xml.FindChildElem(_T("Menu"))) {
+				xml.IntoElem();
+				while (xml.FindChildElem(_T("Unit"))) {
+					xml.IntoElem();
+					contactWithFields = new ContactWithFields();
+					contactWithFields->contact.directory = true;
+					if (xml.FindAttrib(_T("Name"))) {
+						contactWithFields->fields.AddTail(_T("name"));
+						contactWithFields->contact.name = xml.GetAttrib(_T("Name"));
+					}
+					if (xml.FindAttrib(_T("Phone1"))) {
+						contactWithFields->fields.AddTail(_T("number"));
+						contactWithFields->contact.number = xml.GetAttrib(_T("Phone1"));
+					}
+					if (xml.FindAttrib(_T("Phone2"))) {
+						contactWithFields->fields.AddTail(_T("phone"));
+						contactWithFields->contact.phone = xml.GetAttrib(_T("Phone2"));
+					}
+					if (xml.FindAttrib(_T("Phone3"))) {
+						contactWithFields->fields.AddTail(_T("mobile"));
+						contactWithFields->contact.mobile = xml.GetAttrib(_T("Phone3"));
+					}
+					if (Contacts::ContactPrepare(&contactWithFields->contact)) {
+						result->contacts.Add(contactWithFields);
+					}
+					else {
+						delete contactWithFields;
+					}
+					xml.OutOfElem();
+				}
+				xml.OutOfElem();
+			}
+		}
+		else {
+			while (xml.FindChildElem(_T("entry")) || xml.FindChildElem(_T("DirectoryEntry"))) {
+				xml.IntoElem();
+				contactWithFields = new ContactWithFields();
+				contactWithFields->contact.directory = true;
+				if (xml.FindChildElem(_T("extension")) || xml.FindChildElem(_T("Telephone"))) {
+					contactWithFields->fields.AddTail(_T("number"));
+					contactWithFields->contact.number = xml.GetChildData();
+					if (xml.FindChildElem(_T("extension")) || xml.FindChildElem(_T("Telephone"))) {
+						contactWithFields->fields.AddTail(_T("phone"));
+						contactWithFields->contact.phone = xml.GetChildData();
+					}
+					if (xml.FindChildElem(_T("extension")) || xml.FindChildElem(_T("Telephone"))) {
+						contactWithFields->fields.AddTail(_T("mobile"));
+						contactWithFields->contact.mobile = xml.GetChildData();
+					}
+					xml.ResetChildPos();
+				}
+				if (xml.FindChildElem(_T("name")) || xml.FindChildElem(_T("Name"))) {
+					contactWithFields->fields.AddTail(_T("name"));
+					contactWithFields->contact.name = xml.GetChildData();
+					xml.ResetChildPos();
+				}
+				if (xml.FindChildElem(_T("info"))) {
+					contactWithFields->fields.AddTail(_T("info"));
+					contactWithFields->contact.info = xml.GetChildData();
+					xml.ResetChildPos();
+				}
+				if (xml.FindChildElem(_T("presence"))) {
+					contactWithFields->fields.AddTail(_T("presence"));
+					contactWithFields->contact.presence = xml.GetChildData() == _T("1");
+					xml.ResetChildPos();
+				}
+				if (xml.FindChildElem(_T("starred"))) {
+					contactWithFields->fields.AddTail(_T("starred"));
+					contactWithFields->contact.starred = xml.GetChildData() == _T("1");
+					xml.ResetChildPos();
+				}
+				if (Contacts::ContactPrepare(&contactWithFields->contact)) {
+					result->contacts.Add(contactWithFields);
+				}
+				else {
+					delete contactWithFields;
+				}
+				xml.OutOfElem();
+			}
+		}
+	}
+}
+
+// Diffs the result against the directory received last time, kept in the snapshot
+// file, and replaces the file with the directory after it. After the first load a
+// snapshot becomes a delta holding the new and changed entries and a removed entry
+// for each one that is gone.
+void UsersDirectory::Diff(UsersDirectoryState* state, UsersDirectoryResult* result)
+{
+	CArray<ContactWithFields*>& contacts = result->contacts;
+	DirectorySnapshot& snapshot = state->snapshot;
+	int count = contacts.GetCount();
+	int snapshotCount = state->loaded ? snapshot.GetCount() : 0;
+	// entries of the new directory by key, a later entry for the same key replaces the earlier one
+	CMapStringToPtr keys;
+	keys.InitHashTable(count > 4096 ? 65521 : 4099);
+	CArray<bool> seen;
+	seen.SetSize(snapshotCount);
+	// old entries a delta leaves in place
+	CArray<Contact*> copies;
+	// entries dropped from the result, freed once the file is written
+	CArray<ContactWithFields*> unchanged;
+	if (result->delta) {
+		for (int i = 0; i < count; i++) {
+			ContactWithFields* entry = contacts.GetAt(i);
+			CString key = DirectorySnapshot::Key(&entry->contact);
+			// the old entry is matched by id, then by number, as ContactsDiff does
+			int record = -1;
+			if (state->loaded) {
+				if (!entry->contact.id.IsEmpty()) {
+					record = snapshot.Find(key);
+				}
+				if (record == -1 && !entry->contact.number.IsEmpty()) {
+					record = snapshot.FindNumber(entry->contact.number);
+				}
+			}
+			if (record != -1) {
+				seen[record] = true;
+			}
+			if (entry->removed) {
+				keys.RemoveKey(key);
+				if (!entry->contact.id.IsEmpty() && !entry->contact.number.IsEmpty()) {
+					keys.RemoveKey(_T("#") + entry->contact.number);
+				}
+			}
+			else {
+				keys.SetAt(key, &entry->contact);
+			}
+		}
+		for (int i = 0; i < snapshotCount; i++) {
+			if (!seen[i]) {
+				Contact* copy = new Contact();
+				snapshot.Get(i, copy);
+				copies.Add(copy);
+			}
+		}
+	}
+	else {
+		for (int i = 0; i < count; i++) {
+			ContactWithFields* entry = contacts.GetAt(i);
+			keys.SetAt(DirectorySnapshot::Key(&entry->contact), &entry->contact);
+		}
+		if (state->loaded) {
+			CArray<ContactWithFields*> changes;
+			Contact old;
+			for (int i = 0; i < count; i++) {
+				ContactWithFields* entry = contacts.GetAt(i);
+				int record = snapshot.Find(DirectorySnapshot::Key(&entry->contact));
+				CStringList changed;
+				if (record != -1) {
+					seen[record] = true;
+					snapshot.Get(record, &old);
+				}
+				if (record != -1 && !Contacts::ContactDiff(&old, &entry->contact, NULL, &changed)) {
+					unchanged.Add(entry);
+				}
+				else {
+					changes.Add(entry);
+				}
+			}
+			for (int i = 0; i < snapshotCount; i++) {
+				if (!seen[i]) {
+					snapshot.Get(i, &old);
+					ContactWithFields* removed = new ContactWithFields();
+					removed->contact.id = old.id;
+					removed->contact.number = old.number;
+					removed->removed = true;
+					changes.Add(removed);
+				}
+			}
+			contacts.RemoveAll();
+			contacts.Append(changes);
+			result->delta = true;
+		}
+	}
+	CArray<Contact*> model;
+	model.SetSize(0, keys.GetCount() + copies.GetCount());
+	POSITION pos = keys.GetStartPosition();
+	while (pos) {
+		CString key;
+		void* contact;
+		keys.GetNextAssoc(pos, key, contact);
+		model.Add((Contact*)contact);
+	}
+	model.Append(copies);
+	// the mapping has to go before the file can be replaced
+	snapshot.Close();
+	state->loaded = DirectorySnapshot::Write(state->filename, state->key, state->etag, state->lastModified, state->sync, &model)
+		&& snapshot.Open(state->filename);
+	if (!state->loaded) {
+		DeleteFile(state->filename);
+	}
+	for (int i = 0; i < copies.GetCount(); i++) {
+		delete copies.GetAt(i);
+	}
+	for (int i = 0; i < unchanged.GetCount(); i++) {
+		delete unchanged.GetAt(i);
+	}
+}
+
+void UsersDirectory::ModelClear(UsersDirectoryState* state)
+{
+	state->snapshot.Close();
+	state->loaded = false;
+}
+
+void UsersDirectory::StateFree(UsersDirectoryState* state)
+{
+	ModelClear(state);
+	delete state;
+}
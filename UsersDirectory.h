@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2011-2024 MicroSIP (http://www.microsip.org)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#pragma once
+
+#include "global.h"
+#include "ContactStore.h"
+#include "DirectorySnapshot.h"
+
+// what the worker keeps between fetches of the same directory
+struct UsersDirectoryState {
+	// the directory URL without volatile placeholders, the rest belongs to it
+	CString key;
+	CString etag;
+	CString lastModified;
+	CString sync;
+	// last directory received, open when loaded is set
+	CString filename;
+	bool loaded;
+	DirectorySnapshot snapshot;
+	UsersDirectoryState() : loaded(false)
+	{}
+};
+
+struct UsersDirectoryResult {
+	UsersDirectoryState* state;
+	DWORD statusCode;
+	CString headers;
+	// a 200 response with a body
+	bool received;
+	bool ok;
+	// contacts is a change set against the directory applied before, not a snapshot
+	bool delta;
+	// from the payload, -1 when absent
+	int refresh;
+	CArray<ContactWithFields*> contacts;
+	CList<Prensence> prensences;
+	// milliseconds
+	DWORD timeFetch;
+	DWORD timeParse;
+	DWORD timeDiff;
+	UsersDirectoryResult();
+	~UsersDirectoryResult();
+};
+
+// Users directory fetch.
+// Each fetch runs on its own thread, which downloads, parses and normalizes the
+// directory and turns it into a change set against the directory received last time,
+// the result is posted to the window with the UsersDirectoryResult in wParam and the
+// window passes it to Loaded() before applying it. The state (validators, sync token
+// and the last directory) travels with the fetch, a Load() while one runs waits for it.
+//
+// The last directory is kept in a DirectorySnapshot file along with its validators,
+// the fetch diffs against the mapped file and replaces it. At startup Restore() adds
+// the directory contacts from it and resumes with its validators and sync token, so
+// the first refresh can be a 304 or a delta; Contacts.xml then holds local contacts
+// only (HasSnapshot()).
+//
+// Conditional requests: the ETag and Last-Modified of the last directory parsed are
+// sent back as If-None-Match and If-Modified-Since, a 304 carries no contacts.
+//
+// Delta sync: a response may carry a token (JSON "sync" member, XML "sync" attribute
+// of the root element) which is sent back as the sync parameter of the next request.
+// The server may then answer with only the entries changed since, as a "changes" array
+// instead of "items" (XML: a <changes> root instead of <contacts>). Changed entries
+// are complete and merged like snapshot items, entries with removed set to 1 delete the
+// directory contact with their id or number. A server rejecting the token answers 410,
+// or simply a full snapshot, and the directory is fetched again without one.
+class UsersDirectory
+{
+public:
+	UsersDirectory();
+	~UsersDirectory();
+
+	void Load(CString url, CString key, int sequence, HWND hWnd, UINT message);
+	void Loaded(UsersDirectoryResult* result);
+	bool Restore(CString key, ContactStoreProc proc, void* param);
+	bool HasSnapshot();
+	static void Parse(CStringA& body, CString& headers, UsersDirectoryResult* result, CString* sync);
+
+private:
+	// NULL while a fetch runs
+	UsersDirectoryState* state;
+	// directory contacts are kept in the snapshot file
+	bool snapshot;
+	bool pending;
+	CString pendingUrl;
+	CString pendingKey;
+	int pendingSequence;
+	HWND pendingWnd;
+	UINT pendingMessage;
+
+	static DWORD WINAPI FetchThread(LPVOID lpParam);
+	static bool ParseJSON(CStringA& body, UsersDirectoryResult* result, CString* sync);
+	static void ParseXML(CStringA& body, UsersDirectoryResult* result, CString* sync);
+	static void ParseCSV(CStringA& body, UsersDirectoryResult* result);
+	static void Diff(UsersDirectoryState* state, UsersDirectoryResult* result);
+	static void ModelClear(UsersDirectoryState* state);
+	static void StateFree(UsersDirectoryState* state);
+};
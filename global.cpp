@@ -755,6 +755,12 @@ CStringA char2hex(char dec)
 	return r;
 }
 
+#ifndef INTERNET_OPTION_HTTP_DECODING
+#define INTERNET_OPTION_HTTP_DECODING 65
+#endif
+
+#define URL_READ_CHUNK 65536
+
 static DWORD WINAPI URLGetAsyncThread(LPVOID lpParam)
 {
 	URLGetAsyncData* data = (URLGetAsyncData*)lpParam;
@@ -815,16 +821,28 @@ static DWORD WINAPI URLGetAsyncThread(LPVOID lpParam)
 					pFile->SetOption(INTERNET_OPTION_PASSWORD, strPassword.GetBuffer(), strPassword.GetLength());
 				}
 				pFile->SetOption(INTERNET_OPTION_CONNECT_TIMEOUT, 10000);
+				// let WinINet inflate gzip and deflate bodies, offered only where it can
+				BOOL decoding = TRUE;
+				if (HttpHeaderGet(_T("\r\n") + requestHeaders, _T("Accept-Encoding")).IsEmpty()
+					&& pFile->SetOption(INTERNET_OPTION_HTTP_DECODING, &decoding, sizeof(decoding))) {
+					if (!requestHeaders.IsEmpty() && requestHeaders.Right(2) != _T("\r\n")) {
+						requestHeaders.Append(_T("\r\n"));
+					}
+					requestHeaders.Append(_T("Accept-Encoding: gzip, deflate\r\n"));
+				}
 
 				bool status = pFile->SendRequest(requestHeaders, (LPVOID)strFormData.GetBuffer(), strFormData.GetLength());
 				if (status) {
 					pFile->QueryInfoStatusCode(data->statusCode);
-					CStringA buf;
+					DWORD contentLength = 0;
+					if (pFile->QueryInfo(HTTP_QUERY_CONTENT_LENGTH, contentLength) && contentLength) {
+						data->body.Preallocate(contentLength);
+					}
 					int i;
 					UINT len = 0;
 					do {
-						LPSTR p = data->body.GetBuffer(len + 1024);
-						i = pFile->Read(p + len, 1024);
+						LPSTR p = data->body.GetBuffer(len + URL_READ_CHUNK);
+						i = pFile->Read(p + len, URL_READ_CHUNK);
 						len += i;
 						data->body.ReleaseBuffer(len);
 					} while (i > 0);
@@ -893,6 +911,26 @@ URLGetAsyncData URLGetSync(CString url, bool post, CString postData, CString hea
 	return data;
 }
 
+// value of a header in a HTTP_QUERY_RAW_HEADERS_CRLF block, the name is case insensitive
+CString HttpHeaderGet(CString headers, CString name)
+{
+	CString search = _T("\r\n") + name + _T(":");
+	search.MakeLower();
+	CString headersLower = headers;
+	headersLower.MakeLower();
+	int n = headersLower.Find(search);
+	if (n == -1) {
+		return _T("");
+	}
+	n += search.GetLength();
+	int l = headers.Find(_T("\r\n"), n);
+	if (l == -1) {
+		l = headers.GetLength();
+	}
+	CString value = headers.Mid(n, l - n);
+	return value.Trim();
+}
+
 CString get_account_username()
 {
 	CString res = accountSettings.account.username;
@@ -57,6 +57,7 @@ enum EUserWndMessages
 	UM_ON_BALANCE_OPTIONS,
 	UM_ON_COMMAND_LINE,
 	UM_NETWORK_CHANGE,
+	UM_CALLS_EXPORT,
 	
 	IDT_TIMER_IDLE,
 	IDT_TIMER_TONE,
@@ -81,6 +82,8 @@ enum EUserWndMessages
 	UM_DBLCLICKTAB,
 	UM_QUERYTAB,
 	UM_UPDATE_CHECKER_LOADED,
+	UM_USERS_DIRECTORY_SEARCH,
+	IDT_TIMER_DIRECTORY_SEARCH,
 
 };
 
@@ -266,12 +269,15 @@ struct Contact {
 	bool ringing;
 	int image;
 	bool candidate;
+	// node in Contacts::contacts
+	POSITION position;
 	Contact():presence(false)
 		,starred(false)
 		,directory(false)
 		,ringing(false)
 		,image(0)
 		,candidate(false)
+		,position(NULL)
 	{}
 };
 
@@ -279,7 +285,10 @@ struct ContactWithFields {
 	Contact contact;
 	CStringList fields;
 	bool processed;
+	// delta entry removing the contact with this id or number
+	bool removed;
 	ContactWithFields():processed(false)
+		,removed(false)
 	{}
 };
 
@@ -433,6 +442,7 @@ typedef struct {
 } URLGetAsyncData;
 void URLGetAsync(CString url, HWND hWnd=0, UINT message=0, bool post = false, CString postData = _T(""), CString headers = _T(""), CString username = _T(""), CString password = _T(""), void* userData = NULL);
 URLGetAsyncData URLGetSync(CString url, bool post = false, CString postData = _T(""), CString headers = _T(""), CString username = _T(""), CString password = _T(""), void* userData = NULL);
+CString HttpHeaderGet(CString headers, CString name);
 
 CStringA urldecode(CStringA str);
 CStringA urlencode(CStringA str);
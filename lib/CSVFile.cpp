@@ -16,8 +16,13 @@ bool CCSVFile::ReadData(CStringArray &arr)
 	if (!ReadString(sLine))
 		return false;
 	sLine.Trim();
-	LPCTSTR p = sLine;
-	
+	ParseLine(sLine, arr);
+	// We return true if ReadString() succeeded--even if no values
+	return true;
+}
+
+void CCSVFile::ParseLine(LPCTSTR p, CStringArray &arr)
+{
 	int nValue = 0;
 
 	// Parse values in this line
@@ -71,8 +76,6 @@ bool CCSVFile::ReadData(CStringArray &arr)
 	// Trim off any unused array values
 	if (arr.GetCount() > nValue)
 		arr.RemoveAt(nValue, arr.GetCount() - nValue);
-	// We return true if ReadString() succeeded--even if no values
-	return true;
 }
 
 void CCSVFile::WriteData(CStringArray &arr)
@@ -116,3 +119,146 @@ void CCSVFile::WriteData(CStringArray &arr)
 	}
 	WriteString(_T("\n"));
 }
+
+CCSVReader::CCSVReader():
+	m_bFile(false),
+	m_bStart(true),
+	m_pData(NULL),
+	m_nLen(0),
+	m_nPos(0)
+{
+}
+
+bool CCSVReader::Open(LPCTSTR lpszFileName)
+{
+	Close();
+	if (!m_file.Open(lpszFileName, CFile::modeRead | CFile::shareDenyWrite))
+		return false;
+	m_bFile = true;
+	// UTF-16 the way CStdioFileEx tells it: a byte order mark or a zero high byte
+	BYTE head[2];
+	if (m_file.Read(head, 2) == 2 && ((head[0] == 0xFF && head[1] == 0xFE) || head[1] == 0))
+	{
+		// converted to UTF-8 as a whole and read like a buffer
+		if (head[1] != 0)
+			m_file.Seek(2, CFile::begin);
+		else
+			m_file.SeekToBegin();
+		int nBytes = (int)(m_file.GetLength() - m_file.GetPosition());
+		CStringW sWide;
+		LPWSTR pWide = sWide.GetBuffer(nBytes / 2 + 1);
+		int nWide = m_file.Read(pWide, nBytes) / 2;
+		sWide.ReleaseBuffer(nWide);
+		m_file.Close();
+		m_bFile = false;
+		int nUtf8 = WideCharToMultiByte(CP_UTF8, 0, sWide, nWide, NULL, 0, NULL, NULL);
+		LPSTR pUtf8 = m_chunk.GetBuffer(nUtf8);
+		WideCharToMultiByte(CP_UTF8, 0, sWide, nWide, pUtf8, nUtf8, NULL, NULL);
+		m_chunk.ReleaseBuffer(nUtf8);
+		m_pData = m_chunk;
+		m_nLen = nUtf8;
+		return true;
+	}
+	m_file.SeekToBegin();
+	return true;
+}
+
+void CCSVReader::Open(const char* pData, int nLen)
+{
+	Close();
+	m_pData = pData;
+	m_nLen = nLen;
+}
+
+void CCSVReader::Close()
+{
+	if (m_bFile)
+	{
+		m_file.Close();
+		m_bFile = false;
+	}
+	m_chunk.Empty();
+	m_bStart = true;
+	m_pData = NULL;
+	m_nLen = 0;
+	m_nPos = 0;
+}
+
+bool CCSVReader::Fill()
+{
+	if (!m_bFile)
+		return false;
+	LPSTR p = m_chunk.GetBuffer(CHUNK_SIZE);
+	UINT n = m_file.Read(p, CHUNK_SIZE);
+	m_chunk.ReleaseBuffer(n);
+	m_pData = m_chunk;
+	m_nLen = n;
+	m_nPos = 0;
+	return n > 0;
+}
+
+bool CCSVReader::ReadLine(CString &sLine)
+{
+	// bytes of a line running over the end of a chunk
+	CStringA sPartial;
+	const char* pLine = NULL;
+	int nLine = 0;
+	while (true)
+	{
+		if (m_nPos >= m_nLen && !Fill())
+		{
+			if (sPartial.IsEmpty())
+				return false;
+			pLine = sPartial;
+			nLine = sPartial.GetLength();
+			break;
+		}
+		if (m_bStart)
+		{
+			// Skip the UTF-8 byte order mark
+			m_bStart = false;
+			if (m_nLen - m_nPos >= 3 && !memcmp(m_pData + m_nPos, "\xEF\xBB\xBF", 3))
+				m_nPos += 3;
+		}
+		const char* pStart = m_pData + m_nPos;
+		const char* pEnd = (const char*)memchr(pStart, '\n', m_nLen - m_nPos);
+		if (!pEnd)
+		{
+			sPartial.Append(pStart, m_nLen - m_nPos);
+			m_nPos = m_nLen;
+			continue;
+		}
+		m_nPos = (int)(pEnd - m_pData) + 1;
+		if (sPartial.IsEmpty())
+		{
+			pLine = pStart;
+			nLine = (int)(pEnd - pStart);
+		}
+		else
+		{
+			sPartial.Append(pStart, (int)(pEnd - pStart));
+			pLine = sPartial;
+			nLine = sPartial.GetLength();
+		}
+		break;
+	}
+	if (!nLine)
+	{
+		sLine.Empty();
+		return true;
+	}
+	LPTSTR buf = sLine.GetBuffer(nLine);
+	int n = MultiByteToWideChar(CP_UTF8, 0, pLine, nLine, buf, nLine);
+	sLine.ReleaseBuffer(n);
+	return true;
+}
+
+bool CCSVReader::ReadData(CStringArray &arr)
+{
+	CString sLine;
+	if (!ReadLine(sLine))
+		return false;
+	sLine.Trim();
+	CCSVFile::ParseLine(sLine, arr);
+	return true;
+}
@@ -8,4 +8,32 @@ public:
   CCSVFile();
   bool ReadData(CStringArray &arr);
   void WriteData(CStringArray &arr);
+  static void ParseLine(LPCTSTR p, CStringArray &arr);
+};
+
+// Reads UTF-8 CSV records the way CCSVFile does, from a file in fixed size chunks
+// or straight from a buffer the caller keeps alive, one line converted at a time.
+// A UTF-16 file (byte order mark or zero high byte, as CStdioFileEx detects it) is
+// converted to UTF-8 as a whole when opened.
+class CCSVReader
+{
+public:
+  CCSVReader();
+  bool Open(LPCTSTR lpszFileName);
+  void Open(const char* pData, int nLen);
+  void Close();
+  bool ReadData(CStringArray &arr);
+
+private:
+  enum { CHUNK_SIZE = 65536 };
+  CFile m_file;
+  bool m_bFile;
+  bool m_bStart;
+  const char* m_pData;
+  int m_nLen;
+  int m_nPos;
+  CStringA m_chunk;
+
+  bool Fill();
+  bool ReadLine(CString &sLine);
 };
@@ -325,6 +325,20 @@ CString MSIP::Utf8DecodeUni(const char* str)
 	return res;
 }
 
+CString MSIP::Utf8DecodeUni(const char* str, int len)
+{
+	CString res;
+	if (str && len > 0) {
+		int n = MultiByteToWideChar(CP_UTF8, 0, str, len, NULL, 0);
+		if (n > 0) {
+			wchar_t* buf = res.GetBuffer(n);
+			MultiByteToWideChar(CP_UTF8, 0, str, len, buf, n);
+			res.ReleaseBuffer(n);
+		}
+	}
+	return res;
+}
+
 
 CStringA MSIP::Utf8EncodeUni(CString& str)
 {
@@ -601,3 +615,30 @@ CString MSIP::FormatDateTime(CTime* pTime, CTime* pTimeNow)
 		? _T("%X") : _T("%c")
 	);
 }
+
+// writes data to a temporary file next to filename and moves it over the old one
+bool MSIP::FileReplace(CString filename, const CStringA& data)
+{
+	CString tmp = filename + _T(".tmp");
+	CFile file;
+	CFileException fileException;
+	if (!file.Open(tmp, CFile::modeCreate | CFile::modeWrite, &fileException)) {
+		return false;
+	}
+	try {
+		file.Write(data, data.GetLength());
+		file.Flush();
+	}
+	catch (CFileException *e) {
+		e->Delete();
+		file.Close();
+		DeleteFile(tmp);
+		return false;
+	}
+	file.Close();
+	if (!MoveFileEx(tmp, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFile(tmp);
+		return false;
+	}
+	return true;
+}
@@ -47,6 +47,7 @@ void ParseSIPURI(CString in, SIPURI* out);
 CString BuildSIPURI(const SIPURI* in);
 CString PjToStr(const pj_str_t* str, BOOL utf = FALSE);
 CString Utf8DecodeUni(const char* str);
+CString Utf8DecodeUni(const char* str, int len);
 CStringA Utf8EncodeUni(CString& str);
 CStringA UnicodeToAnsi(CString str);
 CString AnsiToUnicode(CStringA str);
@@ -66,4 +67,5 @@ void RunCmd(CString cmdLine, CString addParams=_T(""), bool noWait = false);
 void PortKnock();
 bool IsConnectedToInternet();
 CString FormatDateTime(CTime* pTime, CTime* pTimeNow = NULL);
+bool FileReplace(CString filename, const CStringA& data);
 }
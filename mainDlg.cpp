@@ -26,7 +26,6 @@
 #include "global.h"
 #include "ModelessMessageBox.h"
 #include "json.h"
-#include "Markup.h"
 #include "langpack.h"
 #include "jumplist.h"
 #include "atlenc.h"
@@ -1655,6 +1654,7 @@ BEGIN_MESSAGE_MAP(CmainDlg, CBaseDialog)
 	ON_MESSAGE(UM_ON_PAGER_STATUS, onPagerStatus)
 	ON_MESSAGE(UM_ON_BUDDY_STATE, onBuddyState)
 	ON_MESSAGE(UM_USERS_DIRECTORY, onUsersDirectoryLoaded)
+	ON_MESSAGE(UM_USERS_DIRECTORY_SEARCH, onUsersDirectorySearch)
 	ON_MESSAGE(UM_CUSTOM, onCustomLoaded)
 	ON_MESSAGE(UM_NETWORK_CHANGE, OnNetworkChange)
 	ON_MESSAGE(WM_POWERBROADCAST, OnPowerBroadcast)
@@ -2882,6 +2882,10 @@ void CmainDlg::OnTimer(UINT_PTR TimerVal)
 	else if (TimerVal == IDT_TIMER_DIRECTORY) {
 		UsersDirectoryLoad(true);
 	}
+	else if (TimerVal == IDT_TIMER_DIRECTORY_SEARCH) {
+		KillTimer(IDT_TIMER_DIRECTORY_SEARCH);
+		directorySearch.Search(UsersDirectoryUrl(), usersDirectoryQuery, m_hWnd, UM_USERS_DIRECTORY_SEARCH);
+	}
 	else if (TimerVal == IDT_TIMER_PROGRESS) {
 		OnTimerProgress();
 	}
@@ -3628,6 +3632,7 @@ void CmainDlg::PJAccountAddRaw()
 	}
 	//--
 	status = pjsua_acc_add(&acc_cfg, PJ_TRUE, &account);
+	pageContacts->IndexRebuild();
 	if (status == PJ_SUCCESS) {
 		ok = true;
 		if (acc_cfg.register_on_acc_add == PJ_FALSE) {
@@ -3673,6 +3678,7 @@ void CmainDlg::PJAccountAddLocal()
 		acc_cfg.priority--;
 		pjsua_acc_add(&acc_cfg, PJ_TRUE, &account_local);
 		acc_cfg.priority++;
+		pageContacts->IndexRebuild();
 	}
 }
 
@@ -3685,6 +3691,9 @@ void CmainDlg::PJAccountDelete(bool deep, bool exit, CStringA code)
 	if (pjsua_acc_is_valid(account)) {
 		pjsua_acc_del(account);
 		account = PJSUA_INVALID_ID;
+		if (pageContacts) {
+			pageContacts->IndexRebuild();
+		}
 	}
 
 }
@@ -3694,6 +3703,9 @@ void CmainDlg::PJAccountDeleteLocal()
 	if (pjsua_acc_is_valid(account_local)) {
 		pjsua_acc_del(account_local);
 		account_local = PJSUA_INVALID_ID;
+		if (pageContacts) {
+			pageContacts->IndexRebuild();
+		}
 	}
 }
 
@@ -4947,389 +4959,37 @@ LRESULT CmainDlg::onUsersDirectoryLoaded(WPARAM wParam, LPARAM lParam)
 	CString message;
 	bool reconnect = false;
 	//PJ_LOG(3, (THIS_FILENAME, "Users directory loaded"));
-	URLGetAsyncData* response = (URLGetAsyncData*)wParam;
+	UsersDirectoryResult* response = (UsersDirectoryResult*)wParam;
+	usersDirectory.Loaded(response);
 	if (response->statusCode == 0) {
 		if (usersDirectorySequence == 1) {
 			message = Translate(_T("Connection Failed"));
 		}
 		reconnect = true;
 	}
+	else if (response->statusCode == HTTP_STATUS_NOT_MODIFIED) {
+		// directory unchanged since the validators were stored
+	}
 	else if (response->statusCode >= 300) {
 		if (usersDirectorySequence == 1) {
 			message.Format(_T("%s %d"), Translate(_T("The server returned an error code:")), response->statusCode);
 		}
 	}
-	else if (response->statusCode == 200 && !response->body.IsEmpty()) {
-		CArray<ContactWithFields*> contacts;
-		ContactWithFields* contactWithFields;
-		CList<Prensence> prensences;
-		BOOL ok = FALSE;
-		if (response->headers.Find(_T("Content-Type: text/csv")) != -1) {
-			TCHAR path[MAX_PATH];
-			if (GetTempPath(MAX_PATH, path)) {
-				TCHAR filename[MAX_PATH];
-				if (GetTempFileName(path, _T("csv"), 0, filename)) {
-					CFile tmp;
-					CFileException fileException;
-					if (tmp.Open(filename, CFile::modeWrite, &fileException)) {
-						tmp.Write(response->body, response->body.GetLength());
-						tmp.Close();
-						if (pageContacts->Import(filename, contacts)) {
-							ok = TRUE;
-						}
-					}
-					DeleteFile(filename);
-				}
-			}
-		}
-		else {
-			// JSON
-			Json::Value root;
-			Json::Value items;
-			Json::Value presence;
-			Json::Reader reader;
-			bool parsedSuccess = reader.parse((LPCSTR)response->body,
-				root,
-				false);
-			if (parsedSuccess) {
-				//PJ_LOG(3, (THIS_FILENAME, "JSON foramt detected"));
-				try {
-					if (!root.isArray()) {
-						if (root.isMember("refresh") && root["refresh"].isInt()) {
-							usersDirectoryRefresh = root["refresh"].asInt();
-						}
-						if (root.isMember("items") && root["items"].isArray()) {
-							items = root["items"];
-							ok = true;
-						}
-						if (root.isMember("presence") && root["presence"].isArray()) {
-							presence = root["presence"];
-						}
-					}
-					else {
-						items = root;
-						ok = true;
-					}
-					if (items.isArray()) {
-						for (Json::Value::ArrayIndex i = 0; i != items.size(); i++) {
-							contactWithFields = new ContactWithFields();
-							contactWithFields->contact.directory = true;
-							if (items[i]["name"].isString()) {
-								contactWithFields->fields.AddTail(_T("name"));
-								contactWithFields->contact.name = MSIP::Utf8DecodeUni(items[i]["name"].asCString());
-							}
-							if (items[i]["number"].isString()) {
-								contactWithFields->fields.AddTail(_T("number"));
-								contactWithFields->contact.number = MSIP::Utf8DecodeUni(items[i]["number"].asCString());
-							}
-							else if (items[i]["phone"].isString()) {
-								contactWithFields->fields.AddTail(_T("number"));
-								contactWithFields->contact.number = MSIP::Utf8DecodeUni(items[i]["phone"].asCString());
-							}
-							else if (items[i]["telephone"].isString()) {
-								contactWithFields->fields.AddTail(_T("number"));
-								contactWithFields->contact.number = MSIP::Utf8DecodeUni(items[i]["telephone"].asCString());
-							}
-							if (items[i]["firstname"].isString()) {
-								contactWithFields->fields.AddTail(_T("firstname"));
-								contactWithFields->contact.firstname = MSIP::Utf8DecodeUni(items[i]["firstname"].asCString());
-							}
-							if (items[i]["lastname"].isString()) {
-								contactWithFields->fields.AddTail(_T("lastname"));
-								contactWithFields->contact.lastname = MSIP::Utf8DecodeUni(items[i]["lastname"].asCString());
-							}
-							if (items[i]["phone"].isString()) {
-								contactWithFields->fields.AddTail(_T("phone"));
-								contactWithFields->contact.phone = MSIP::Utf8DecodeUni(items[i]["phone"].asCString());
-							}
-							if (items[i]["mobile"].isString()) {
-								contactWithFields->fields.AddTail(_T("mobile"));
-								contactWithFields->contact.mobile = MSIP::Utf8DecodeUni(items[i]["mobile"].asCString());
-							}
-							if (items[i]["email"].isString()) {
-								contactWithFields->fields.AddTail(_T("email"));
-								contactWithFields->contact.email = MSIP::Utf8DecodeUni(items[i]["email"].asCString());
-							}
-							if (items[i]["address"].isString()) {
-								contactWithFields->fields.AddTail(_T("address"));
-								contactWithFields->contact.address = MSIP::Utf8DecodeUni(items[i]["address"].asCString());
-							}
-							if (items[i]["city"].isString()) {
-								contactWithFields->fields.AddTail(_T("city"));
-								contactWithFields->contact.city = MSIP::Utf8DecodeUni(items[i]["city"].asCString());
-							}
-							if (items[i]["state"].isString()) {
-								contactWithFields->fields.AddTail(_T("state"));
-								contactWithFields->contact.state = MSIP::Utf8DecodeUni(items[i]["state"].asCString());
-							}
-							if (items[i]["zip"].isString()) {
-								contactWithFields->fields.AddTail(_T("zip"));
-								contactWithFields->contact.zip = MSIP::Utf8DecodeUni(items[i]["zip"].asCString());
-							}
-							if (items[i]["comment"].isString()) {
-								contactWithFields->fields.AddTail(_T("comment"));
-								contactWithFields->contact.comment = MSIP::Utf8DecodeUni(items[i]["comment"].asCString());
-							}
-							if (items[i]["id"].isString()) {
-								contactWithFields->fields.AddTail(_T("id"));
-								contactWithFields->contact.id = MSIP::Utf8DecodeUni(items[i]["id"].asCString());
-							}
-							if (items[i]["info"].isString()) {
-								contactWithFields->fields.AddTail(_T("info"));
-								contactWithFields->contact.info = MSIP::Utf8DecodeUni(items[i]["info"].asCString());
-							}
-							if (items[i]["presence"].isInt()) {
-								contactWithFields->fields.AddTail(_T("presence"));
-								contactWithFields->contact.presence = items[i]["presence"].asInt() ? 1 : 0;
-							}
-							if (items[i]["starred"].isInt()) {
-								contactWithFields->fields.AddTail(_T("starred"));
-								contactWithFields->contact.starred = items[i]["starred"].asInt() ? 1 : 0;
-							}
-							if (pageContacts->ContactPrepare(&contactWithFields->contact)) {
-								contacts.Add(contactWithFields);
-							}
-							else {
-								delete contactWithFields;
-							}
-						}
-					}
-					if (presence.isArray()) {
-						for (Json::Value::ArrayIndex i = 0; i != presence.size(); i++) {
-							if (presence[i]["number"].isString() && presence[i]["status"].isString()) {
-								CString number = MSIP::Utf8DecodeUni(presence[i]["number"].asCString());
-								CString status = MSIP::Utf8DecodeUni(presence[i]["status"].asCString());
-								CString info;
-								if (presence[i]["info"].isString()) {
-									info = MSIP::Utf8DecodeUni(presence[i]["info"].asCString());
-								}
-								int image;
-								bool ringing = false;
-								if (status == _T("offline")) {
-									image = MSIP_CONTACT_ICON_OFFLINE;
-								}
-								else if (status == _T("online")) {
-									image = MSIP_CONTACT_ICON_ONLINE;
-								}
-								else if (status == _T("away")) {
-									image = MSIP_CONTACT_ICON_AWAY;
-								}
-								else if (status == _T("busy")) {
-									image = MSIP_CONTACT_ICON_BUSY;
-								}
-								else if (status == _T("ring")) {
-									image = MSIP_CONTACT_ICON_ON_THE_PHONE;
-									ringing = true;
-								}
-								else if (status == _T("phone")) {
-									image = MSIP_CONTACT_ICON_ON_THE_PHONE;
-								}
-								else {
-									image = MSIP_CONTACT_ICON_UNKNOWN;
-								}
-								Prensence prensence;
-								prensence.number = number;
-								prensence.image = image;
-								prensence.ringing = ringing;
-								prensence.info = info;
-								prensences.AddTail(prensence);
-							}
-						}
-					}
-				}
-				catch (std::exception const& e) {
-				}
-			}
-			else {
-				// XML
-				//PJ_LOG(3, (THIS_FILENAME, "XML foramt detected"));
-				CMarkup xml;
-				BOOL bResult = xml.SetDoc(MSIP::Utf8DecodeUni(response->body));
-				if (bResult) {
-					ok = true;
-					if (xml.FindElem(_T("contacts"))) {
-						if (xml.FindAttrib(_T("refresh"))) {
-							usersDirectoryRefresh = _wtoi(xml.GetAttrib(_T("refresh")));
-						}
-						while (xml.FindChildElem(_T("contact"))) {
-							xml.IntoElem();
-							contactWithFields = new ContactWithFields();
-							contactWithFields->contact.directory = true;
-							if (xml.FindAttrib(_T("name"))) {
-								contactWithFields->fields.AddTail(_T("name"));
-								contactWithFields->contact.name = xml.GetAttrib(_T("name"));
-							}
-							if (xml.FindAttrib(_T("number"))) {
-								contactWithFields->fields.AddTail(_T("number"));
-								contactWithFields->contact.number = xml.GetAttrib(_T("number"));
-							}
-							if (xml.FindAttrib(_T("firstname"))) {
-								contactWithFields->fields.AddTail(_T("firstname"));
-								contactWithFields->contact.firstname = xml.GetAttrib(_T("firstname"));
-							}
-							if (xml.FindAttrib(_T("lastname"))) {
-								contactWithFields->fields.AddTail(_T("lastname"));
-								contactWithFields->contact.lastname = xml.GetAttrib(_T("lastname"));
-							}
-							if (xml.FindAttrib(_T("phone"))) {
-								contactWithFields->fields.AddTail(_T("phone"));
-								contactWithFields->contact.phone = xml.GetAttrib(_T("phone"));
-							}
-							if (xml.FindAttrib(_T("mobile"))) {
-								contactWithFields->fields.AddTail(_T("mobile"));
-								contactWithFields->contact.mobile = xml.GetAttrib(_T("mobile"));
-							}
-							if (xml.FindAttrib(_T("email"))) {
-								contactWithFields->fields.AddTail(_T("email"));
-								contactWithFields->contact.email = xml.GetAttrib(_T("email"));
-							}
-							if (xml.FindAttrib(_T("address"))) {
-								contactWithFields->fields.AddTail(_T("address"));
-								contactWithFields->contact.address = xml.GetAttrib(_T("address"));
-							}
-							if (xml.FindAttrib(_T("city"))) {
-								contactWithFields->fields.AddTail(_T("city"));
-								contactWithFields->contact.city = xml.GetAttrib(_T("city"));
-							}
-							if (xml.FindAttrib(_T("state"))) {
-								contactWithFields->fields.AddTail(_T("state"));
-								contactWithFields->contact.state = xml.GetAttrib(_T("state"));
-							}
-							if (xml.FindAttrib(_T("zip"))) {
-								contactWithFields->fields.AddTail(_T("zip"));
-								contactWithFields->contact.zip = xml.GetAttrib(_T("zip"));
-							}
-							if (xml.FindAttrib(_T("comment"))) {
-								contactWithFields->fields.AddTail(_T("comment"));
-								contactWithFields->contact.comment = xml.GetAttrib(_T("comment"));
-							}
-							if (xml.FindAttrib(_T("id"))) {
-								contactWithFields->fields.AddTail(_T("id"));
-								contactWithFields->contact.id = xml.GetAttrib(_T("id"));
-							}
-							if (xml.FindAttrib(_T("info"))) {
-								contactWithFields->fields.AddTail(_T("info"));
-								contactWithFields->contact.info = xml.GetAttrib(_T("info"));
-							}
-							if (xml.FindAttrib(_T("presence"))) {
-								contactWithFields->fields.AddTail(_T("presence"));
-								CString rab = xml.GetAttrib(_T("presence"));
-								contactWithFields->contact.presence = rab == _T("1");
-							}
-							if (xml.FindAttrib(_T("starred"))) {
-								contactWithFields->fields.AddTail(_T("starred"));
-								CString rab = xml.GetAttrib(_T("starred"));
-								contactWithFields->contact.starred = rab == _T("1");
-							}
-							if (pageContacts->ContactPrepare(&contactWithFields->contact)) {
-								contacts.Add(contactWithFields);
-							}
-							else {
-								delete contactWithFields;
-							}
-							xml.OutOfElem();
-						}
-					}
-					else if (xml.FindElem(_T("YealinkIPPhoneBook"))) {
-						while (xml.FindChildElem(_T("Menu"))) {
-							xml.IntoElem();
-							while (xml.FindChildElem(_T("Unit"))) {
-								xml.IntoElem();
-								contactWithFields = new ContactWithFields();
-								contactWithFields->contact.directory = true;
-								if (xml.FindAttrib(_T("Name"))) {
-									contactWithFields->fields.AddTail(_T("name"));
-									contactWithFields->contact.name = xml.GetAttrib(_T("Name"));
-								}
-								if (xml.FindAttrib(_T("Phone1"))) {
-									contactWithFields->fields.AddTail(_T("number"));
-									contactWithFields->contact.number = xml.GetAttrib(_T("Phone1"));
-								}
-								if (xml.FindAttrib(_T("Phone2"))) {
-									contactWithFields->fields.AddTail(_T("phone"));
-									contactWithFields->contact.phone = xml.GetAttrib(_T("Phone2"));
-								}
-								if (xml.FindAttrib(_T("Phone3"))) {
-									contactWithFields->fields.AddTail(_T("mobile"));
-									contactWithFields->contact.mobile = xml.GetAttrib(_T("Phone3"));
-								}
-								if (pageContacts->ContactPrepare(&contactWithFields->contact)) {
-									contacts.Add(contactWithFields);
-								}
-								else {
-									delete contactWithFields;
-								}
-								xml.OutOfElem();
-							}
-							xml.OutOfElem();
-						}
-					}
-					else {
-						while (xml.FindChildElem(_T("entry")) || xml.FindChildElem(_T("DirectoryEntry"))) {
-							xml.IntoElem();
-							contactWithFields = new ContactWithFields();
-							contactWithFields->contact.directory = true;
-							if (xml.FindChildElem(_T("extension")) || xml.FindChildElem(_T("Telephone"))) {
-								contactWithFields->fields.AddTail(_T("number"));
-								contactWithFields->contact.number = xml.GetChildData();
-								if (xml.FindChildElem(_T("extension")) || xml.FindChildElem(_T("Telephone"))) {
-									contactWithFields->fields.AddTail(_T("phone"));
-									contactWithFields->contact.phone = xml.GetChildData();
-								}
-								if (xml.FindChildElem(_T("extension")) || xml.FindChildElem(_T("Telephone"))) {
-									contactWithFields->fields.AddTail(_T("mobile"));
-									contactWithFields->contact.mobile = xml.GetChildData();
-								}
-								xml.ResetChildPos();
-							}
-							if (xml.FindChildElem(_T("name")) || xml.FindChildElem(_T("Name"))) {
-								contactWithFields->fields.AddTail(_T("name"));
-								contactWithFields->contact.name = xml.GetChildData();
-								xml.ResetChildPos();
-							}
-							if (xml.FindChildElem(_T("info"))) {
-								contactWithFields->fields.AddTail(_T("info"));
-								contactWithFields->contact.info = xml.GetChildData();
-								xml.ResetChildPos();
-							}
-							if (xml.FindChildElem(_T("presence"))) {
-								contactWithFields->fields.AddTail(_T("presence"));
-								contactWithFields->contact.presence = xml.GetChildData() == _T("1");
-								xml.ResetChildPos();
-							}
-							if (xml.FindChildElem(_T("starred"))) {
-								contactWithFields->fields.AddTail(_T("starred"));
-								contactWithFields->contact.starred = xml.GetChildData() == _T("1");
-								xml.ResetChildPos();
-							}
-							if (pageContacts->ContactPrepare(&contactWithFields->contact)) {
-								contacts.Add(contactWithFields);
-							}
-							else {
-								delete contactWithFields;
-							}
-							xml.OutOfElem();
-						}
-					}
-				}
-			}
+	else if (response->received) {
+		if (response->refresh != -1) {
+			usersDirectoryRefresh = response->refresh;
 		}
 		bool sort = false;
-		if (ok) {
-			pageContacts->ContactsAdd(&contacts, true);
-			for (int i = 0; i < contacts.GetCount(); i++) {
-				contactWithFields = contacts.GetAt(i);
-				delete contactWithFields;
-			}
+		DWORD tick = GetTickCount();
+		if (response->ok) {
+			sort = pageContacts->ContactsAdd(&response->contacts, true, response->delta);
 			usersDirectoryLoaded = true;
-			sort = true;
 		}
 
-		POSITION pos = prensences.GetHeadPosition();
+		POSITION pos = response->prensences.GetHeadPosition();
 		if (pos) {
 			while (pos) {
-				POSITION posKey = pos;
-				Prensence prensence = prensences.GetNext(pos);
+				Prensence prensence = response->prensences.GetNext(pos);
 				pageContacts->PresenceReceived(&prensence.number, prensence.image, prensence.ringing, &prensence.info, true);
 				pageDialer->PresenceReceived(&prensence.number, prensence.image, prensence.ringing, true);
 			};
@@ -5337,39 +4997,33 @@ LRESULT CmainDlg::onUsersDirectoryLoaded(WPARAM wParam, LPARAM lParam)
 				sort = true;
 			}
 		}
-		if (sort) {
+		if (sort && !pageContacts->isFiltered()) {
 			pageContacts->m_SortItemsExListCtrl.SortColumn(pageContacts->m_SortItemsExListCtrl.GetSortColumn(), pageContacts->m_SortItemsExListCtrl.IsAscending());
 		}
-		if (usersDirectoryRefresh == -1) {
-			response->headers.MakeLower();
-			CString search = _T("\r\ncache-control:");
-			int n = response->headers.Find(search);
-			if (n > 0) {
-				n = n + search.GetLength();
-				int l = response->headers.Find(_T("\r\n"), n);
-				if (l > 0) {
-					response->headers = response->headers.Mid(n, l - n);
-					search = _T("max-age=");
-					n = response->headers.Find(search);
-					if (n != -1) {
-						response->headers = response->headers.Mid(n + search.GetLength());
-						usersDirectoryRefresh = atoi(CStringA(response->headers));
-					}
-				}
-			}
-			if (usersDirectoryRefresh < 60) {
-				usersDirectoryRefresh = 60;
-			}
-			if (usersDirectoryRefresh > 86400) {
-				usersDirectoryRefresh = 86400;
-			}
-		}
+		PJ_LOG(3, (THIS_FILENAME, "Users directory %s of %d entries: fetch %lu ms, parse %lu ms, diff %lu ms, apply %lu ms",
+			response->delta ? "delta" : "snapshot", (int)response->contacts.GetCount(),
+			response->timeFetch, response->timeParse, response->timeDiff, GetTickCount() - tick));
 		if (usersDirectorySequence == 1) {
-			if (!ok) {
+			if (!response->ok) {
 				message = Translate(_T("The received data cannot be recognized"));
 			}
 		}
 	}
+	if ((response->statusCode == 200 || response->statusCode == HTTP_STATUS_NOT_MODIFIED) && usersDirectoryRefresh == -1) {
+		CString cacheControl = HttpHeaderGet(response->headers, _T("Cache-Control"));
+		cacheControl.MakeLower();
+		CString search = _T("max-age=");
+		int n = cacheControl.Find(search);
+		if (n != -1) {
+			usersDirectoryRefresh = atoi(CStringA(cacheControl.Mid(n + search.GetLength())));
+		}
+		if (usersDirectoryRefresh < 60) {
+			usersDirectoryRefresh = 60;
+		}
+		if (usersDirectoryRefresh > 86400) {
+			usersDirectoryRefresh = 86400;
+		}
+	}
 	if (usersDirectoryRefresh <= 0) {
 		usersDirectoryRefresh = 3600;
 	}
@@ -5391,6 +5045,20 @@ LRESULT CmainDlg::onUsersDirectoryLoaded(WPARAM wParam, LPARAM lParam)
 	return 0;
 }
 
+// stable leaves out the placeholders that change on every request
+CString CmainDlg::UsersDirectoryUrl(bool stable)
+{
+	CString url = accountSettings.usersDirectory;
+	if (stable) {
+		url.Replace(_T("{time}"), _T(""));
+	}
+	url.Replace(_T("%"), _T("*"));
+	url.Replace(_T("*s"), _T("%s"));
+	url.Format(url, accountSettings.account.username, accountSettings.account.password, get_account_server());
+	url.Replace(_T("*"), _T("%"));
+	return msip_url_mask(url);
+}
+
 void CmainDlg::UsersDirectoryLoad(bool update)
 {
 	KillTimer(IDT_TIMER_DIRECTORY);
@@ -5398,23 +5066,40 @@ void CmainDlg::UsersDirectoryLoad(bool update)
 		usersDirectorySequence = 0;
 		usersDirectoryRefresh = -1;
 	}
-	if (!accountSettings.usersDirectory.IsEmpty()) {
+	// a searched directory is never downloaded as a whole
+	if (!accountSettings.usersDirectory.IsEmpty() && !DirectorySearch::IsEnabled()) {
 		//PJ_LOG(3, (THIS_FILENAME, "Users directory load"));
-		CString url = accountSettings.usersDirectory;
-		url.Replace(_T("%"), _T("*"));
-		url.Replace(_T("*s"), _T("%s"));
-		url.Format(url, accountSettings.account.username, accountSettings.account.password, get_account_server());
-		url.Replace(_T("*"), _T("%"));
-		url = msip_url_mask(url);
-		url.AppendFormat(_T("%ssequence=%d"), url.Find('?') == -1 ? _T("?") : _T("&"), usersDirectorySequence);
-		usersDirectorySequence++;
+		CString url = UsersDirectoryUrl();
 		//PJ_LOG(3, (THIS_FILENAME, "Begin UsersDirectoryLoad"));
-		URLGetAsync(url, m_hWnd, UM_USERS_DIRECTORY
-			, false
-		);
+		usersDirectory.Load(url, UsersDirectoryUrl(true), usersDirectorySequence, m_hWnd, UM_USERS_DIRECTORY);
+		usersDirectorySequence++;
 	}
 }
 
+// debounced, the query is sent once typing pauses
+void CmainDlg::UsersDirectorySearch(CString query)
+{
+	if (!DirectorySearch::IsEnabled()) {
+		return;
+	}
+	usersDirectoryQuery = query;
+	KillTimer(IDT_TIMER_DIRECTORY_SEARCH);
+	SetTimer(IDT_TIMER_DIRECTORY_SEARCH, DIRECTORY_SEARCH_DELAY, NULL);
+}
+
+LRESULT CmainDlg::onUsersDirectorySearch(WPARAM wParam, LPARAM lParam)
+{
+	DirectorySearchResult* result = (DirectorySearchResult*)wParam;
+	if (directorySearch.Searched(result)) {
+		if (pageContacts->ContactsAdd(&result->contacts, true, true) && !pageContacts->isFiltered()) {
+			pageContacts->m_SortItemsExListCtrl.SortColumn(pageContacts->m_SortItemsExListCtrl.GetSortColumn(), pageContacts->m_SortItemsExListCtrl.IsAscending());
+		}
+		pageDialer->SuggestRefresh();
+	}
+	delete result;
+	return 0;
+}
+
 void CmainDlg::AccountSettingsPendingSave()
 {
 	KillTimer(IDT_TIMER_SAVE);
@@ -5552,7 +5237,7 @@ void CmainDlg::OnUpdatePane(CCmdUI* pCmdUI)
 	pCmdUI->Enable();
 }
 
-void CmainDlg::SubsribeNumber(CString * number)
+void CmainDlg::SubsribeNumber(CString * number, CString * numberPresence, CString * uri)
 {
 	if (!isSubscribed) {
 		return;
@@ -5561,7 +5246,7 @@ void CmainDlg::SubsribeNumber(CString * number)
 		return;
 	}
 	CString commands;
-	CString numberFormated = FormatNumber(*number, &commands, true);
+	CString numberFormated = numberPresence ? *numberPresence : FormatNumber(*number, &commands, true);
 
 	pjsua_buddy_id ids[PJSUA_MAX_BUDDIES];
 	unsigned count = PJSUA_MAX_BUDDIES;
@@ -5573,21 +5258,29 @@ void CmainDlg::SubsribeNumber(CString * number)
 			return;
 		}
 	}
-	CString numberFormatedPresence = numberFormated;
-	pj_status_t status = msip_verify_sip_url(numberFormatedPresence);
-	if (status == PJ_SUCCESS) {
-		pjsua_acc_id acc_id;
-		pj_str_t pj_uri;
-		if (SelectSIPAccount(numberFormatedPresence, acc_id, &pj_uri)) {
-			pjsua_buddy_id p_buddy_id;
-			pjsua_buddy_config buddy_cfg;
-			pjsua_buddy_config_default(&buddy_cfg);
-			buddy_cfg.subscribe = PJ_TRUE;
-			buddy_cfg.uri = pj_uri;
-			buddy_cfg.user_data = (void*)(new CString(numberFormated));
-			status = pjsua_buddy_add(&buddy_cfg, &p_buddy_id);
-			free(pj_uri.ptr);
-		}
+	pj_status_t status = PJ_SUCCESS;
+	pjsua_acc_id acc_id;
+	pj_str_t pj_uri;
+	bool selected;
+	if (uri && !uri->IsEmpty()) {
+		// resolved when the contact was indexed
+		pj_uri = MSIP::StrToPjStr(*uri);
+		selected = true;
+	}
+	else {
+		CString numberFormatedPresence = numberFormated;
+		status = msip_verify_sip_url(numberFormatedPresence);
+		selected = status == PJ_SUCCESS && SelectSIPAccount(numberFormatedPresence, acc_id, &pj_uri);
+	}
+	if (selected) {
+		pjsua_buddy_id p_buddy_id;
+		pjsua_buddy_config buddy_cfg;
+		pjsua_buddy_config_default(&buddy_cfg);
+		buddy_cfg.subscribe = PJ_TRUE;
+		buddy_cfg.uri = pj_uri;
+		buddy_cfg.user_data = (void*)(new CString(numberFormated));
+		status = pjsua_buddy_add(&buddy_cfg, &p_buddy_id);
+		free(pj_uri.ptr);
 	}
 	if (status != PJ_SUCCESS) {
 		CString str;
@@ -5597,7 +5290,7 @@ void CmainDlg::SubsribeNumber(CString * number)
 	}
 }
 
-void CmainDlg::UnsubscribeNumber(CString * number)
+void CmainDlg::UnsubscribeNumber(CString * number, CString * numberPresence)
 {
 	if (!isSubscribed) {
 		return;
@@ -5606,7 +5299,7 @@ void CmainDlg::UnsubscribeNumber(CString * number)
 		return;
 	}
 	CString commands;
-	CString numberFormated = FormatNumber(*number, &commands, true);
+	CString numberFormated = numberPresence ? *numberPresence : FormatNumber(*number, &commands, true);
 
 	pjsua_buddy_id ids[PJSUA_MAX_BUDDIES];
 	unsigned count = PJSUA_MAX_BUDDIES;
@@ -43,6 +43,8 @@
 #include "Preview.h"
 #include "Transfer.h"
 #include "StatusBar.h"
+#include "UsersDirectory.h"
+#include "DirectorySearch.h"
 
 // CmainDlg dialog
 class CmainDlg : public CBaseDialog
@@ -68,6 +70,9 @@ public:
 	Dialer* pageDialer;
 	Contacts* pageContacts;
 	bool usersDirectoryLoaded;
+	UsersDirectory usersDirectory;
+	DirectorySearch directorySearch;
+	CString usersDirectoryQuery;
 	bool shortcutsURLLoaded;
 	Calls* pageCalls;
 
@@ -129,8 +134,8 @@ public:
 	void ShortcutAction(Shortcut *shortcut, bool block = false, bool second = false);
 	void ShortcutsRemoveAll();
 	bool isSubscribed;
-	void SubsribeNumber(CString *number);
-	void UnsubscribeNumber(CString* number);
+	void SubsribeNumber(CString *number, CString* numberPresence = NULL, CString* uri = NULL);
+	void UnsubscribeNumber(CString* number, CString* numberPresence = NULL);
 	void Subscribe();
 	void Unsubscribe();
 	void PlayerPlay(CString filename, bool noLoop = false, bool inCall = false, bool isAA = false);
@@ -138,8 +143,11 @@ public:
 	void OnTimerProgress();
 	void OnTimerCall();
 
+	CString UsersDirectoryUrl(bool stable = false);
 	void UsersDirectoryLoad(bool update = false);
 	afx_msg LRESULT onUsersDirectoryLoaded(WPARAM wParam,LPARAM lParam);
+	void UsersDirectorySearch(CString query);
+	afx_msg LRESULT onUsersDirectorySearch(WPARAM wParam, LPARAM lParam);
 	LRESULT onShortcutsURLLoaded(WPARAM wParam, LPARAM lParam);
 	void ShortcutsURLLoad();
 	afx_msg LRESULT onCustomLoaded(WPARAM wParam, LPARAM lParam);
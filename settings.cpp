@@ -577,6 +577,16 @@ void AccountSettings::Init()
 	str.ReleaseBuffer();
 	maxConcurrentCalls = _wtoi(str);
 
+	ptr = str.GetBuffer(255);
+	GetPrivateProfileString(section, _T("callerIdPrefix"), NULL, ptr, 256, iniFile);
+	str.ReleaseBuffer();
+	callerIdPrefix = str.IsEmpty() ? 3 : _wtoi(str);
+
+	ptr = str.GetBuffer(255);
+	GetPrivateProfileString(section, _T("callerIdRank"), NULL, ptr, 256, iniFile);
+	str.ReleaseBuffer();
+	callerIdRank = _wtoi(str);
+
 	ptr = str.GetBuffer(255);
 	GetPrivateProfileString(section, _T("noIgnoreCall"), NULL, ptr, 256, iniFile);
 	str.ReleaseBuffer();
@@ -1127,6 +1137,10 @@ void AccountSettings::SettingsSave()
 
 	str.Format(_T("%d"), maxConcurrentCalls);
 	WritePrivateProfileString(section, _T("maxConcurrentCalls"), str, iniFile);
+	str.Format(_T("%d"), callerIdPrefix);
+	WritePrivateProfileString(section, _T("callerIdPrefix"), str, iniFile);
+	str.Format(_T("%d"), callerIdRank);
+	WritePrivateProfileString(section, _T("callerIdRank"), str, iniFile);
 	WritePrivateProfileString(section, _T("noIgnoreCall"), noIgnoreCall ? _T("1") : _T("0"), iniFile);
 	WritePrivateProfileString(section, _T("cmdOutgoingCall"), _T("\"") + cmdOutgoingCall + _T("\""), iniFile);
 	WritePrivateProfileString(section, _T("cmdIncomingCall"), _T("\"") + cmdIncomingCall + _T("\""), iniFile);
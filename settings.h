@@ -146,6 +146,8 @@ struct AccountSettings {
 	
 	int autoHangUpTime;
 	int maxConcurrentCalls;
+	int callerIdPrefix;
+	int callerIdRank;
 	bool callWaiting;
 	bool noIgnoreCall;
 